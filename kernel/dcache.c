@@ -0,0 +1,190 @@
+// Directory entry cache.
+//
+// The dentry cache remembers the result of recent directory
+// lookups, so that namex() can resolve a path element without
+// reading the directory's blocks.  Each entry maps
+// (dev, parent inum, name) to the inum the name refers to, or
+// to 0 if the name is known not to exist (a negative entry).
+//
+// Interface:
+// * namex() calls dcachelookup() before dirlookup() and
+//   dcacheenter() after it, holding the parent's ip->lock.
+// * dirlink() and dirunlink() call dcacheinval() for the name
+//   they change, also holding the parent's ip->lock, so a
+//   lookup can never see an entry that is out of date.
+// * iput() calls dcachepurge() when it frees an inode, since
+//   its inum may be reused for a different directory.
+//
+// Entries live on a hash chain for lookup and on an LRU list
+// for recycling, both protected by dcache.lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+
+#define NDHASH 61
+
+struct dentry {
+	uint dev;
+	uint parent;           // inum of the directory
+	char name[DIRSIZ];
+	uint inum;             // inum of name, or 0 if absent
+	int valid;
+	struct dentry *hnext;  // hash chain
+	struct dentry *prev;   // LRU list
+	struct dentry *next;
+};
+
+struct {
+	struct spinlock lock;
+	struct dentry dentry[NDENTRY];
+	struct dentry *hash[NDHASH];
+
+	// Linked list of all entries, through prev/next.
+	// head.next is most recently used.
+	struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+	struct dentry *d;
+
+	initlock(&dcache.lock, "dcache");
+
+	dcache.head.prev = &dcache.head;
+	dcache.head.next = &dcache.head;
+	for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++){
+		d->next = dcache.head.next;
+		d->prev = &dcache.head;
+		dcache.head.next->prev = d;
+		dcache.head.next = d;
+	}
+}
+
+static uint
+dhash(uint dev, uint parent, char *name)
+{
+	return (dirhash(name) ^ (parent * 31) ^ dev) % NDHASH;
+}
+
+// Find the entry for (dev, parent, name).
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint parent, char *name)
+{
+	struct dentry *d;
+
+	for(d = dcache.hash[dhash(dev, parent, name)]; d; d = d->hnext)
+		if(d->dev == dev && d->parent == parent && namecmp(d->name, name) == 0)
+			return d;
+	return 0;
+}
+
+// Take d off its hash chain and make it the next to be recycled.
+// Caller must hold dcache.lock.
+static void
+dremove(struct dentry *d)
+{
+	struct dentry **pp;
+
+	for(pp = &dcache.hash[dhash(d->dev, d->parent, d->name)]; *pp; pp = &(*pp)->hnext){
+		if(*pp == d){
+			*pp = d->hnext;
+			break;
+		}
+	}
+	d->valid = 0;
+	d->next->prev = d->prev;
+	d->prev->next = d->next;
+	d->prev = dcache.head.prev;
+	d->next = &dcache.head;
+	dcache.head.prev->next = d;
+	dcache.head.prev = d;
+}
+
+// Move d to the head of the MRU list.
+// Caller must hold dcache.lock.
+static void
+dtouch(struct dentry *d)
+{
+	d->next->prev = d->prev;
+	d->prev->next = d->next;
+	d->next = dcache.head.next;
+	d->prev = &dcache.head;
+	dcache.head.next->prev = d;
+	dcache.head.next = d;
+}
+
+// Look up name in directory parent.  On a hit, set *inum to
+// the cached inum (0 for a negative entry) and return 1.
+// Return 0 if the cache knows nothing about name.
+int
+dcachelookup(uint dev, uint parent, char *name, uint *inum)
+{
+	struct dentry *d;
+
+	acquire(&dcache.lock);
+	if((d = dfind(dev, parent, name)) == 0){
+		release(&dcache.lock);
+		return 0;
+	}
+	*inum = d->inum;
+	dtouch(d);
+	release(&dcache.lock);
+	return 1;
+}
+
+// Record that name in directory parent refers to inum,
+// or does not exist if inum is 0.
+void
+dcacheenter(uint dev, uint parent, char *name, uint inum)
+{
+	struct dentry *d;
+	uint h;
+
+	acquire(&dcache.lock);
+	if((d = dfind(dev, parent, name)) == 0){
+		// Recycle the least recently used entry.
+		d = dcache.head.prev;
+		if(d->valid)
+			dremove(d);
+		d->dev = dev;
+		d->parent = parent;
+		strncpy(d->name, name, DIRSIZ);
+		d->valid = 1;
+		h = dhash(dev, parent, name);
+		d->hnext = dcache.hash[h];
+		dcache.hash[h] = d;
+	}
+	d->inum = inum;
+	dtouch(d);
+	release(&dcache.lock);
+}
+
+// Forget what is known about name in directory parent.
+void
+dcacheinval(uint dev, uint parent, char *name)
+{
+	struct dentry *d;
+
+	acquire(&dcache.lock);
+	if((d = dfind(dev, parent, name)) != 0)
+		dremove(d);
+	release(&dcache.lock);
+}
+
+// Forget every entry in directory parent.
+void
+dcachepurge(uint dev, uint parent)
+{
+	struct dentry *d;
+
+	acquire(&dcache.lock);
+	for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++)
+		if(d->valid && d->dev == dev && d->parent == parent)
+			dremove(d);
+	release(&dcache.lock);
+}
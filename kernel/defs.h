@@ -2,13 +2,18 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockstat;
 struct pipe;
 struct proc;
+struct rwlock;
 struct rtcdate;
+struct seqlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct vdso;
 
 // bio.c
 void            binit(void);
@@ -22,6 +27,13 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// dcache.c
+void            dcacheinit(void);
+void            dcacheenter(uint, uint, char*, uint);
+void            dcacheinval(uint, uint, char*);
+int             dcachelookup(uint, uint, char*, uint*);
+void            dcachepurge(uint, uint);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -38,7 +50,9 @@ int             filewrite(struct file*, char*, int n);
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+void            dirunlink(struct inode*, char*, uint);
+struct inode*   ialloc(uint, short, uint);
+void            icacheinit(void);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
@@ -53,6 +67,10 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futex(uint, int, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -65,9 +83,12 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+int             kderef(char*);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             kshared(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -78,7 +99,13 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicarm(void);
+int             lapicticks(void);
+extern uint     lapicmhz;
 void            lapicstartap(uchar, uint);
+void            lapictickless(int);
+void            lapicwakeup(int);
+extern uint     tscmhz;
 void            microdelay(int);
 
 // log.c
@@ -86,6 +113,8 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+void            begin_opn(int);
+void            end_opn(int);
 
 // mp.c
 extern int      ismp;
@@ -99,13 +128,18 @@ void            picinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
+int             pipesize(struct pipe*, int);
 int             pipewrite(struct pipe*, char*, int);
 
 // proc.c
+void            boost(void);
+extern uint     boostticks;
+int             clone(void(*)(void*), void*, void*);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             join(uint*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -113,13 +147,32 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedtick(void);
+int             setpriority(int, int);
 void            setproc(struct proc*);
+int             sysctl(int, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
+// rwlock.c
+void            acquireread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+void            initrwlock(struct rwlock*, char*);
+void            releaseread(struct rwlock*);
+void            releasewrite(struct rwlock*);
+
+// seqlock.c
+void            acquireseq(struct seqlock*);
+void            initseqlock(struct seqlock*, char*);
+uint            readseqbegin(struct seqlock*);
+int             readseqretry(struct seqlock*, uint);
+void            releaseseq(struct seqlock*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -128,6 +181,9 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockbench(int);
+int             lockstat(int, struct lockstat*);
+void            lockstatreset(void);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -157,12 +213,16 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            timeradd(struct timer*, int, void (*)(void*), void*);
+int             timerdel(struct timer*);
+int             timersleep(int);
+void            timertick(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
-extern struct spinlock tickslock;
+extern struct seqlock tickslock;
 
 // uart.c
 void            uartinit(void);
@@ -170,6 +230,7 @@ void            uartintr(void);
 void            uartputc(int);
 
 // vm.c
+extern int      havesysenter;
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
@@ -184,6 +245,12 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             cowbreak(pde_t*, uint);
+int             cowfault(pde_t*, uint);
+char*           vmlend(pde_t*, char*);
+char*           vmremap(pde_t*, char*, char*);
+extern struct vdso *vdso;
+void            vdsosetpid(pde_t*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
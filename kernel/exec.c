@@ -2,6 +2,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
@@ -94,6 +95,7 @@ exec(char *path, char **argv)
 	safestrcpy(curproc->name, last, sizeof(curproc->name));
 
 	// Commit to the user image.
+	vdsosetpid(pgdir, curproc->pid);
 	oldpgdir = curproc->pgdir;
 	curproc->pgdir = pgdir;
 	curproc->sz = sz;
@@ -123,25 +123,28 @@ filewrite(struct file *f, char *addr, int n)
 	if(f->type == FD_PIPE)
 		return pipewrite(f->pipe, addr, n);
 	if(f->type == FD_INODE){
-		// write a few blocks at a time to avoid exceeding
-		// the maximum log transaction size, including
-		// i-node, indirect block, allocation blocks,
-		// and 2 blocks of slop for non-aligned writes.
+		// Reserve enough of the log for the blocks written,
+		// plus a bitmap block per block written, the i-node,
+		// the indirect block, and 2 blocks of slop for
+		// non-aligned writes. A write that fits in the log
+		// is a single transaction; a larger one is streamed
+		// as a series of full, block-aligned transactions.
 		// this really belongs lower down, since writei()
 		// might be writing a device like the console.
-		int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+		int max = ((LOGSIZE-1-1-2) / 2) * BSIZE;
 		int i = 0;
 		while(i < n){
 			int n1 = n - i;
-			if(n1 > max)
-				n1 = max;
+			if(n1 > max - f->off % BSIZE)
+				n1 = max - f->off % BSIZE;
+			int nop = (n1 + BSIZE - 1) / BSIZE * 2 + 1 + 1 + 2;
 
-			begin_op();
+			begin_opn(nop);
 			ilock(f->ip);
 			if ((r = writei(f->ip, addr + i, f->off, n1)) > 0) // poziva se writei(ip, niz karaktera, offset - ne koristi se, duzina niza = 1)
 				f->off += r;
 			iunlock(f->ip);
-			end_op();
+			end_opn(nop);
 
 			if(r < 0)
 				break;
@@ -14,6 +14,9 @@ struct inode { //* opis fajla
 	uint dev;           // Device number
 	uint inum;          // Inode number
 	int ref;            // Reference count
+	struct inode *hnext; // icache hash chain
+	struct inode *prev; // icache LRU list, while ref is zero
+	struct inode *next;
 	struct sleeplock lock; // protects everything below here
 	int valid;          // inode has been read from disk?
 
@@ -22,7 +25,11 @@ struct inode { //* opis fajla
 	short minor;
 	short nlink;
 	uint size;
+	uint hashstart;
 	uint addrs[NDIRECT+1];
+
+	uint dirfree;       // lowest dirent offset that may be free (T_DIR)
+	int hashused;       // non-empty hash index slots, or -1 if not counted
 };
 
 // table mapping major device number to
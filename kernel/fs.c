@@ -14,8 +14,9 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -23,6 +24,8 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void hashfree(struct inode*);
+static void imapinit(int);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb;
@@ -51,28 +54,91 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
-
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+//
+// The free-block summary keeps, for each bitmap block, a count
+// of the free blocks it describes, so balloc() can skip full
+// bitmap blocks without reading them, plus a next-fit cursor
+// where the last allocation ended. bsum.nfree[i] is only changed
+// while holding the buffer of bitmap block i; the cursor is
+// just a hint.
+
+static struct {
+	uint *nfree;     // free blocks per bitmap block
+	uint nbmap;      // number of bitmap blocks
+	uint cursor;     // where the next search starts
+} bsum;
+
+// Count the free blocks in each bitmap block.
+static void
+bsuminit(int dev)
 {
-	int b, bi, m;
 	struct buf *bp;
+	uint b, w, m, *map;
 
-	bp = 0;
+	bsum.nbmap = (sb.size + BPB - 1) / BPB;
+	if(bsum.nbmap > PGSIZE / sizeof(uint) || (bsum.nfree = (uint*)kalloc()) == 0)
+		panic("bsuminit");
+	memset(bsum.nfree, 0, PGSIZE);
 	for(b = 0; b < sb.size; b += BPB){
 		bp = bread(dev, BBLOCK(b, sb));
-		for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-			m = 1 << (bi % 8);
-			if((bp->data[bi/8] & m) == 0){  // Is block free?
-				bp->data[bi/8] |= m;  // Mark block in use.
+		map = (uint*)bp->data;
+		for(w = 0; w < BPB / 32 && b + w * 32 < sb.size; w++){
+			m = ~map[w];
+			if(sb.size - (b + w * 32) < 32)
+				m &= (1 << (sb.size - (b + w * 32))) - 1;
+			for(; m; m &= m - 1)
+				bsum.nfree[b / BPB]++;
+		}
+		brelse(bp);
+	}
+	bsum.cursor = sb.bmapstart;
+}
+
+// Allocate a zeroed disk block, preferably goal so that
+// a file being written sequentially stays contiguous.
+// goal 0 means no preference.
+static uint
+balloc(uint dev, uint goal)
+{
+	uint b, bi, w, m, i, n, *map;
+	struct buf *bp;
+
+	if(goal == 0 || goal >= sb.size)
+		goal = bsum.cursor;
+	b = goal - goal % BPB;
+	bi = goal % BPB;
+	// The block holding goal is visited twice: once from goal
+	// onwards, and last from its start.
+	for(n = 0; n <= bsum.nbmap; n++){
+		i = b / BPB;
+		if(bsum.nfree[i] > 0){
+			bp = bread(dev, BBLOCK(b, sb));
+			map = (uint*)bp->data;
+			// Test 32 bits at a time.
+			for(w = bi / 32; w < BPB / 32 && b + w * 32 < sb.size; w++){
+				m = ~map[w];
+				if(w == bi / 32)
+					m &= ~0U << (bi % 32);
+				if(m == 0)
+					continue;
+				m = __builtin_ctz(m);
+				if(b + w * 32 + m >= sb.size)
+					break;
+				map[w] |= 1 << m;  // Mark block in use.
+				bsum.nfree[i]--;
 				log_write(bp);
 				brelse(bp);
-				bzero(dev, b + bi);
-				return b + bi;
+				b += w * 32 + m;
+				bsum.cursor = b + 1;
+				bzero(dev, b);
+				return b;
 			}
+			brelse(bp);
 		}
-		brelse(bp);
+		b += BPB;
+		if(b >= sb.size)
+			b = 0;
+		bi = 0;
 	}
 	panic("balloc: out of blocks");
 }
@@ -90,6 +156,7 @@ bfree(int dev, uint b)
 	if((bp->data[bi/8] & m) == 0)
 		panic("freeing free block");
 	bp->data[bi/8] &= ~m;
+	bsum.nfree[b / BPB]++;
 	log_write(bp);
 	brelse(bp);
 }
@@ -154,31 +221,80 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// The icache.lock reader-writer lock protects the allocation of
+// icache entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// Lookups that find an entry already in use, and idup(), need only
+// hold it for reading, and raise ip->ref atomically; anything that
+// lowers ref or moves an entry on or off the LRU list or the hash
+// table holds it for writing.
+//
+// Entries are found through a hash table on (dev, inum).
+// An entry whose ref has fallen to zero stays in the hash table,
+// so a later iget() of the same inode reuses its cached contents,
+// and also sits on an LRU list from which iget() recycles the
+// least recently used entry. icacheinit() allocates room for
+// NINODE entries at boot; iget() adds a page of entries whenever
+// none is free, so the cache is bounded only by memory.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
-	struct spinlock lock;
-	struct inode inode[NINODE];
+	struct rwlock lock;
+	struct inode *hash[NIHASH];
+	int ninode;
+
+	// Unreferenced entries, through prev/next.
+	// lru.next is least recently used.
+	struct inode lru;
 } icache;
 
-void
-iinit(int dev)
+// Add a page worth of free entries to the inode cache.
+// Caller must hold icache.lock for writing.
+static int
+igrow(void)
 {
-	int i = 0;
+	struct inode *ip, *ep;
+	char *mem;
 
-	initlock(&icache.lock, "icache");
-	for(i = 0; i < NINODE; i++) {
-		initsleeplock(&icache.inode[i].lock, "inode");
+	if((mem = kalloc()) == 0)
+		return -1;
+	memset(mem, 0, PGSIZE);
+	ep = (struct inode*)mem + PGSIZE / sizeof(struct inode);
+	for(ip = (struct inode*)mem; ip < ep; ip++){
+		initsleeplock(&ip->lock, "inode");
+		ip->next = &icache.lru;
+		ip->prev = icache.lru.prev;
+		icache.lru.prev->next = ip;
+		icache.lru.prev = ip;
+		icache.ninode++;
 	}
+	return 0;
+}
 
+void
+icacheinit(void)
+{
+	initrwlock(&icache.lock, "icache");
+	icache.lru.prev = &icache.lru;
+	icache.lru.next = &icache.lru;
+	while(icache.ninode < NINODE)
+		if(igrow() < 0)
+			panic("icacheinit");
+}
+
+void
+iinit(int dev)
+{
 	readsb(dev, &sb);
+	bsuminit(dev);
+	imapinit(dev);
 	cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
 		sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
@@ -187,29 +303,106 @@ iinit(int dev)
 
 static struct inode* iget(uint dev, uint inum);
 
-// Allocate an inode on device dev.
+// Free-inode map.
+//
+// imap.used has a bit per on-disk inode, set while the inode is
+// allocated (and for inum 0, which is never used). iinit() builds
+// it by reading the inode blocks once; afterwards ialloc() finds
+// a free inode without reading the disk.
+
+static struct {
+	struct spinlock lock;
+	uint *used;
+	uint nword;
+} imap;
+
+static void
+imapinit(int dev)
+{
+	struct buf *bp;
+	struct dinode *dip;
+	uint inum, i;
+
+	initlock(&imap.lock, "imap");
+	imap.nword = (sb.ninodes + 31) / 32;
+	if(imap.nword > PGSIZE / sizeof(uint) || (imap.used = (uint*)kalloc()) == 0)
+		panic("imapinit");
+	memset(imap.used, 0, PGSIZE);
+	for(inum = sb.ninodes; inum < imap.nword * 32; inum++)
+		imap.used[inum / 32] |= 1 << (inum % 32);
+	imap.used[0] |= 1;
+	for(inum = 0; inum < sb.ninodes; inum += IPB){
+		bp = bread(dev, IBLOCK(inum, sb));
+		dip = (struct dinode*)bp->data;
+		for(i = inum; i < inum + IPB && i < sb.ninodes; i++, dip++)
+			if(dip->type != 0)
+				imap.used[i / 32] |= 1 << (i % 32);
+		brelse(bp);
+	}
+}
+
+// Allocate an inode number, starting the search at the
+// inode block that holds near.
+static int
+imapalloc(uint near)
+{
+	uint n, w, m, start;
+
+	start = (near - near % IPB) % (imap.nword * 32);
+	acquire(&imap.lock);
+	w = start / 32;
+	for(n = 0; n <= imap.nword; n++, w = (w + 1) % imap.nword){
+		m = ~imap.used[w];
+		if(n == 0)
+			m &= ~0U << (start % 32);
+		if(m == 0)
+			continue;
+		m = __builtin_ctz(m);
+		imap.used[w] |= 1 << m;
+		release(&imap.lock);
+		return w * 32 + m;
+	}
+	release(&imap.lock);
+	return -1;
+}
+
+static void
+imapfree(uint inum)
+{
+	acquire(&imap.lock);
+	imap.used[inum / 32] &= ~(1 << (inum % 32));
+	release(&imap.lock);
+}
+
+// Allocate an inode on device dev, close to inode near
+// (usually the parent directory) if possible.
 // Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
+// Returns an unlocked but allocated and referenced inode,
+// or 0 if the inode cache is out of memory.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint near)
 {
 	int inum;
 	struct buf *bp;
 	struct dinode *dip;
+	struct inode *ip;
 
-	for(inum = 1; inum < sb.ninodes; inum++){
-		bp = bread(dev, IBLOCK(inum, sb));
-		dip = (struct dinode*)bp->data + inum%IPB;
-		if(dip->type == 0){  // a free inode
-			memset(dip, 0, sizeof(*dip));
-			dip->type = type;
-			log_write(bp);   // mark it allocated on the disk
-			brelse(bp);
-			return iget(dev, inum);
-		}
-		brelse(bp);
+	if((inum = imapalloc(near)) < 0)
+		panic("ialloc: no inodes");
+	bp = bread(dev, IBLOCK(inum, sb));
+	dip = (struct dinode*)bp->data + inum%IPB;
+	if(dip->type != 0)
+		panic("ialloc: inode in use");
+	memset(dip, 0, sizeof(*dip));
+	dip->type = type;
+	log_write(bp);   // mark it allocated on the disk
+	if((ip = iget(dev, inum)) == 0){
+		dip->type = 0;
+		log_write(bp);
+		imapfree(inum);
 	}
-	panic("ialloc: no inodes");
+	brelse(bp);
+	return ip;
 }
 
 // Copy a modified in-memory inode to disk.
@@ -229,6 +422,7 @@ iupdate(struct inode *ip)
 	dip->minor = ip->minor;
 	dip->nlink = ip->nlink;
 	dip->size = ip->size;
+	dip->hashstart = ip->hashstart;
 	memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
 	log_write(bp);
 	brelse(bp);
@@ -237,35 +431,63 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+// Returns 0 if the cache is full and cannot grow.
 static struct inode*
 iget(uint dev, uint inum)
 {
-	struct inode *ip, *empty;
+	struct inode *ip, **pp;
+	int ref;
+
+	// Is the inode already cached and in use?  Most
+	// lookups are, and readers do not serialize.
+	acquireread(&icache.lock);
+	for(ip = icache.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+		if(ip->dev == dev && ip->inum == inum){
+			while((ref = ip->ref) > 0)
+				if(__sync_val_compare_and_swap(&ip->ref, ref, ref+1) == ref){
+					releaseread(&icache.lock);
+					return ip;
+				}
+			break;
+		}
+	}
+	releaseread(&icache.lock);
 
-	acquire(&icache.lock);
+	acquirewrite(&icache.lock);
 
 	// Is the inode already cached?
-	empty = 0;
-	for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-		if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-			ip->ref++;
-			release(&icache.lock);
+	for(ip = icache.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+		if(ip->dev == dev && ip->inum == inum){
+			if(ip->ref++ == 0){
+				ip->next->prev = ip->prev;
+				ip->prev->next = ip->next;
+			}
+			releasewrite(&icache.lock);
 			return ip;
 		}
-		if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-			empty = ip;
 	}
 
-	// Recycle an inode cache entry.
-	if(empty == 0)
-		panic("iget: no inodes");
+	// Recycle the least recently used inode cache entry.
+	if(icache.lru.next == &icache.lru && igrow() < 0){
+		releasewrite(&icache.lock);
+		return 0;
+	}
+	ip = icache.lru.next;
+	ip->next->prev = ip->prev;
+	ip->prev->next = ip->next;
+	if(ip->inum != 0){
+		for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+			;
+		*pp = ip->hnext;
+	}
 
-	ip = empty;
 	ip->dev = dev;
 	ip->inum = inum;
 	ip->ref = 1;
 	ip->valid = 0;
-	release(&icache.lock);
+	ip->hnext = icache.hash[IHASH(dev, inum)];
+	icache.hash[IHASH(dev, inum)] = ip;
+	releasewrite(&icache.lock);
 
 	return ip;
 }
@@ -275,9 +497,9 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-	acquire(&icache.lock);
-	ip->ref++;
-	release(&icache.lock);
+	acquireread(&icache.lock);
+	__sync_fetch_and_add(&ip->ref, 1);
+	releaseread(&icache.lock);
 	return ip;
 }
 
@@ -302,8 +524,11 @@ ilock(struct inode *ip)
 		ip->minor = dip->minor;
 		ip->nlink = dip->nlink;
 		ip->size = dip->size;
+		ip->hashstart = dip->hashstart;
 		memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
 		brelse(bp);
+		ip->dirfree = 0;
+		ip->hashused = -1;
 		ip->valid = 1;
 		if(ip->type == 0)
 			panic("ilock: no type");
@@ -322,7 +547,7 @@ iunlock(struct inode *ip)
 
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
-// be recycled.
+// be recycled, though it keeps its contents until it is.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -330,24 +555,46 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+	int ref;
+
 	acquiresleep(&ip->lock);
 	if(ip->valid && ip->nlink == 0){
-		acquire(&icache.lock);
+		acquireread(&icache.lock);
 		int r = ip->ref;
-		release(&icache.lock);
+		releaseread(&icache.lock);
 		if(r == 1){
 			// inode has no links and no other references: truncate and free.
 			itrunc(ip);
+			if(ip->type == T_DIR)
+				dcachepurge(ip->dev, ip->inum);
 			ip->type = 0;
 			iupdate(ip);
+			imapfree(ip->inum);
 			ip->valid = 0;
 		}
 	}
 	releasesleep(&ip->lock);
 
-	acquire(&icache.lock);
-	ip->ref--;
-	release(&icache.lock);
+	// Most puts leave other references, and drop theirs under
+	// the read lock, as iget takes them.  Only the last one
+	// takes the write lock, to put the entry on the LRU list.
+	acquireread(&icache.lock);
+	while((ref = ip->ref) > 1)
+		if(__sync_val_compare_and_swap(&ip->ref, ref, ref-1) == ref){
+			releaseread(&icache.lock);
+			return;
+		}
+	releaseread(&icache.lock);
+
+	acquirewrite(&icache.lock);
+	if(--ip->ref == 0){
+		// Move to the most recently used end of the LRU list.
+		ip->next = &icache.lru;
+		ip->prev = icache.lru.prev;
+		icache.lru.prev->next = ip;
+		icache.lru.prev = ip;
+	}
+	releasewrite(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -366,7 +613,8 @@ iunlockput(struct inode *ip)
 // listed in block ip->addrs[NDIRECT].
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, next to
+// block bn-1 if possible.
 static uint
 bmap(struct inode *ip, uint bn)
 {
@@ -375,7 +623,7 @@ bmap(struct inode *ip, uint bn)
 
 	if(bn < NDIRECT){
 		if((addr = ip->addrs[bn]) == 0)
-			ip->addrs[bn] = addr = balloc(ip->dev);
+			ip->addrs[bn] = addr = balloc(ip->dev, bn > 0 && ip->addrs[bn-1] ? ip->addrs[bn-1] + 1 : 0);
 		return addr;
 	}
 	bn -= NDIRECT;
@@ -383,11 +631,11 @@ bmap(struct inode *ip, uint bn)
 	if(bn < NINDIRECT){
 		// Load indirect block, allocating if necessary.
 		if((addr = ip->addrs[NDIRECT]) == 0)
-			ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+			ip->addrs[NDIRECT] = addr = balloc(ip->dev, ip->addrs[NDIRECT-1] ? ip->addrs[NDIRECT-1] + 1 : 0);
 		bp = bread(ip->dev, addr);
 		a = (uint*)bp->data;
 		if((addr = a[bn]) == 0){
-			a[bn] = addr = balloc(ip->dev);
+			a[bn] = addr = balloc(ip->dev, bn > 0 && a[bn-1] ? a[bn-1] + 1 : ip->addrs[NDIRECT] + 1);
 			log_write(bp);
 		}
 		brelse(bp);
@@ -428,6 +676,9 @@ itrunc(struct inode *ip)
 		ip->addrs[NDIRECT] = 0;
 	}
 
+	if(ip->hashstart)
+		hashfree(ip);
+
 	ip->size = 0;
 	iupdate(ip);
 }
@@ -515,17 +766,172 @@ namecmp(const char *s, const char *t)
 	return strncmp(s, t, DIRSIZ);
 }
 
+// Directory hash index.
+//
+// A directory with hashstart != 0 keeps every live dirent in
+// its hash index, so lookups probe the index instead of scanning
+// the directory. Callers must hold dp->lock.
+
+// Probe dp's hash index for name.  If found, return the byte
+// offset of its dirent and set *pslot to its index slot.
+// Otherwise return -1 and set *pslot to the first slot an
+// insert of name could use, or DIRHASHSLOTS if the index is full.
+static int
+hashprobe(struct inode *dp, char *name, uint *pslot)
+{
+	uint i, s, slot, off;
+	ushort v;
+	struct buf *bp;
+	struct dirent de;
+
+	bp = 0;
+	slot = DIRHASHSLOTS;
+	s = dirhash(name) % DIRHASHSLOTS;
+	for(i = 0; i < DIRHASHSLOTS; i++, s = (s + 1) % DIRHASHSLOTS){
+		if(bp == 0 || bp->blockno != HBLOCK(s, dp)){
+			if(bp)
+				brelse(bp);
+			bp = bread(dp->dev, HBLOCK(s, dp));
+		}
+		v = ((ushort*)bp->data)[s % HPB];
+		if(v == 0){
+			if(slot == DIRHASHSLOTS)
+				slot = s;
+			break;
+		}
+		if(v == DIRHASH_DEL){
+			if(slot == DIRHASHSLOTS)
+				slot = s;
+			continue;
+		}
+		off = (v - 1) * sizeof(de);
+		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+			panic("hashprobe read");
+		if(de.inum != 0 && namecmp(name, de.name) == 0){
+			brelse(bp);
+			*pslot = s;
+			return off;
+		}
+	}
+	if(bp)
+		brelse(bp);
+	*pslot = slot;
+	return -1;
+}
+
+// Return slot s of dp's hash index.
+static ushort
+hashget(struct inode *dp, uint s)
+{
+	struct buf *bp;
+	ushort v;
+
+	bp = bread(dp->dev, HBLOCK(s, dp));
+	v = ((ushort*)bp->data)[s % HPB];
+	brelse(bp);
+	return v;
+}
+
+// Store v in slot s of dp's hash index.
+static void
+hashset(struct inode *dp, uint s, ushort v)
+{
+	struct buf *bp;
+
+	bp = bread(dp->dev, HBLOCK(s, dp));
+	((ushort*)bp->data)[s % HPB] = v;
+	log_write(bp);
+	brelse(bp);
+}
+
+// Empty slot s of dp's hash index.  Rather than leave a
+// deleted marker, which probes for missing names would have
+// to walk past, shift back any later entry in the probe run
+// whose home slot is at or before the hole (Knuth's
+// algorithm R for linear probing).  Old DIRHASH_DEL slots
+// stay where they are.
+static void
+hashdelete(struct inode *dp, uint s)
+{
+	uint j, home;
+	ushort v;
+	struct dirent de;
+
+	for(j = (s + 1) % DIRHASHSLOTS; (v = hashget(dp, j)) != 0; j = (j + 1) % DIRHASHSLOTS){
+		if(v == DIRHASH_DEL)
+			continue;
+		if(readi(dp, (char*)&de, (v - 1) * sizeof(de), sizeof(de)) != sizeof(de))
+			panic("hashdelete read");
+		home = dirhash(de.name) % DIRHASHSLOTS;
+		// Leave the entry if its home lies cyclically in (s, j].
+		if(s < j ? (home > s && home <= j) : (home > s || home <= j))
+			continue;
+		hashset(dp, s, v);
+		s = j;
+	}
+	hashset(dp, s, 0);
+	if(dp->hashused > 0)
+		dp->hashused--;
+}
+
+// Return the number of non-empty slots in dp's hash index,
+// counting them the first time after dp is read from disk.
+static int
+hashcount(struct inode *dp)
+{
+	struct buf *bp;
+	ushort *a;
+	int i, j;
+
+	if(dp->hashused >= 0)
+		return dp->hashused;
+	dp->hashused = 0;
+	for(i = 0; i < NDIRHASH; i++){
+		bp = bread(dp->dev, dp->hashstart + i);
+		a = (ushort*)bp->data;
+		for(j = 0; j < HPB; j++)
+			if(a[j] != 0)
+				dp->hashused++;
+		brelse(bp);
+	}
+	return dp->hashused;
+}
+
+// Release dp's hash index; dp reverts to linear lookups.
+static void
+hashfree(struct inode *dp)
+{
+	int i;
+
+	for(i = 0; i < NDIRHASH; i++)
+		bfree(dp->dev, dp->hashstart + i);
+	dp->hashstart = 0;
+	iupdate(dp);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Also returns 0 if the inode cache is full.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-	uint off, inum;
+	uint off, inum, slot;
+	int hoff;
 	struct dirent de;
 
 	if(dp->type != T_DIR)
 		panic("dirlookup not DIR");
 
+	if(dp->hashstart){
+		if((hoff = hashprobe(dp, name, &slot)) < 0)
+			return 0;
+		if(readi(dp, (char*)&de, hoff, sizeof(de)) != sizeof(de))
+			panic("dirlookup read");
+		if(poff)
+			*poff = hoff;
+		return iget(dp->dev, de.inum);
+	}
+
 	for(off = 0; off < dp->size; off += sizeof(de)){
 		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 			panic("dirlookup read");
@@ -548,31 +954,78 @@ int
 dirlink(struct inode *dp, char *name, uint inum)
 {
 	int off;
+	uint slot, doff;
 	struct dirent de;
 	struct inode *ip;
 
-	// Check that name is not present.
-	if((ip = dirlookup(dp, name, 0)) != 0){
-		iput(ip);
-		return -1;
+	// Check that name is not present, even if the inode
+	// cache is too full for dirlookup to return it.
+	if(dp->hashstart){
+		if(hashprobe(dp, name, &slot) >= 0)
+			return -1;
+	} else {
+		doff = -1;
+		if((ip = dirlookup(dp, name, &doff)) != 0)
+			iput(ip);
+		if(doff != -1)
+			return -1;
 	}
 
-	// Look for an empty dirent.
-	for(off = 0; off < dp->size; off += sizeof(de)){
+	// Look for an empty dirent, starting past the ones
+	// known to be in use.
+	for(off = dp->dirfree; off < dp->size; off += sizeof(de)){
 		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 			panic("dirlink read");
 		if(de.inum == 0)
 			break;
 	}
 
+	// Fall back to linear lookups once the directory holds
+	// more entries than the index has room for.
+	if(dp->hashstart && (off / sizeof(de) >= DIRHASHMAX ||
+	   slot == DIRHASHSLOTS || hashcount(dp) >= DIRHASHMAX))
+		hashfree(dp);
+
+	dcacheinval(dp->dev, dp->inum, name);
+
 	strncpy(de.name, name, DIRSIZ);
 	de.inum = inum;
 	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 		panic("dirlink");
+	dp->dirfree = off + sizeof(de);
+
+	if(dp->hashstart){
+		if(hashget(dp, slot) == 0)
+			dp->hashused++;
+		hashset(dp, slot, off / sizeof(de) + 1);
+	}
 
 	return 0;
 }
 
+// Remove the entry for name, found by dirlookup at byte
+// offset off, from the directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+	uint slot;
+	struct dirent de;
+
+	if(dp->hashstart){
+		if(hashprobe(dp, name, &slot) != (int)off)
+			panic("dirunlink: index");
+		hashdelete(dp, slot);
+	}
+
+	dcacheinval(dp->dev, dp->inum, name);
+
+	memset(&de, 0, sizeof(de));
+	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+		panic("dirunlink: writei");
+	if(off < dp->dirfree)
+		dp->dirfree = off;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -615,16 +1068,20 @@ skipelem(char *path, char *name)
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// Each element is looked up in the dentry cache (dcache.c) first.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
 	struct inode *ip, *next;
+	uint inum, off;
 
 	if(*path == '/')
 		ip = iget(ROOTDEV, ROOTINO);
 	else
 		ip = idup(myproc()->cwd);
+	if(ip == 0)
+		return 0;
 
 	while((path = skipelem(path, name)) != 0){
 		ilock(ip);
@@ -637,7 +1094,17 @@ namex(char *path, int nameiparent, char *name)
 			iunlock(ip);
 			return ip;
 		}
-		if((next = dirlookup(ip, name, 0)) == 0){
+		if(dcachelookup(ip->dev, ip->inum, name, &inum)){
+			next = inum ? iget(ip->dev, inum) : 0;
+		} else {
+			// A found entry with no inode means the inode
+			// cache is full, not that the name is missing.
+			off = -1;
+			next = dirlookup(ip, name, &off);
+			if(next || off == -1)
+				dcacheenter(ip->dev, ip->inum, name, next ? next->inum : 0);
+		}
+		if(next == 0){
 			iunlockput(ip);
 			return 0;
 		}
@@ -21,7 +21,7 @@ struct superblock {
 	uint bmapstart;    // Block number of first free map block
 };
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
 
@@ -32,6 +32,7 @@ struct dinode {
 	short minor;          // Minor device number (T_DEV only)
 	short nlink;          // Number of links to inode in file system
 	uint size;            // Size of file (bytes)
+	uint hashstart;       // First block of hash index (T_DIR only), or 0
 	uint addrs[NDIRECT+1];   // Data block addresses
 };
 
@@ -55,3 +56,32 @@ struct dirent {
 	char name[DIRSIZ];
 };
 
+// A directory may carry a hash index: NDIRHASH contiguous blocks
+// starting at hashstart, holding an open-addressed table of ushort
+// slots.  A slot is 0 (empty), DIRHASH_DEL (deleted, left by older
+// kernels), or the index of a dirent in the directory plus one.
+// mkfs builds the index; unlink shifts later entries back instead
+// of leaving a deleted slot, and the kernel drops the index if the
+// directory outgrows DIRHASHMAX entries.
+#define NDIRHASH      8
+#define HPB           (BSIZE / sizeof(ushort))
+#define DIRHASHSLOTS  (NDIRHASH * HPB)
+#define DIRHASHMAX    (DIRHASHSLOTS / 4 * 3)
+#define DIRHASH_DEL   0xFFFF
+
+// Block of hash index containing slot s
+#define HBLOCK(s, ip) ((ip)->hashstart + (s) / HPB)
+
+// Hash of a directory entry name, shared by mkfs and the kernel.
+static inline uint
+dirhash(const char *name)
+{
+	uint h;
+	int i;
+
+	h = 2166136261U;
+	for(i = 0; i < DIRSIZ && name[i]; i++)
+		h = (h ^ (uchar)name[i]) * 16777619U;
+	return h;
+}
+
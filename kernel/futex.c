@@ -0,0 +1,69 @@
+// Futexes: sleep and wakeup on a word of user memory.
+//
+// A futex is named by the physical address of the word,
+// so threads sharing an address space, or processes
+// sharing a page, meet on the same wait channel.  The
+// channel is the word's kernel address.  futexlock makes
+// the check of the word and the sleep atomic with respect
+// to wakers.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "futex.h"
+
+struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+	initlock(&futexlock, "futex");
+}
+
+// Return the kernel address of the user word at uaddr,
+// or 0 if it is not a mapped, aligned user address.
+static uint*
+futexaddr(uint uaddr)
+{
+	struct proc *curproc = myproc();
+	char *ka;
+
+	if(uaddr % sizeof(uint) || uaddr >= curproc->sz)
+		return 0;
+	if((ka = uva2ka(curproc->pgdir, (char*)uaddr)) == 0)
+		return 0;
+	return (uint*)(ka + uaddr % PGSIZE);
+}
+
+int
+futex(uint uaddr, int op, int val)
+{
+	uint *ka;
+	int r;
+
+	if((ka = futexaddr(uaddr)) == 0)
+		return -1;
+
+	acquire(&futexlock);
+	switch(op){
+	case FUTEX_WAIT:
+		r = 0;
+		if(*ka != val)
+			r = -1;
+		else if(myproc()->killed)
+			r = -1;
+		else
+			sleep(ka, &futexlock);
+		break;
+	case FUTEX_WAKE:
+		r = wakeupn(ka, val);
+		break;
+	default:
+		r = -1;
+	}
+	release(&futexlock);
+	return r;
+}
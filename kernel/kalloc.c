@@ -17,10 +17,14 @@ struct run {
 	struct run *next;
 };
 
+// ref[] counts the holders of each allocated page, so
+// that a page shared between address spaces is freed
+// only when the last of them lets go.
 struct {
 	struct spinlock lock;
 	int use_lock;
 	struct run *freelist;
+	ushort ref[PHYSTOP/PGSIZE];
 } kmem;
 
 // Initialization happens in two phases.
@@ -48,14 +52,17 @@ freerange(void *vstart, void *vend)
 {
 	char *p;
 	p = (char*)PGROUNDUP((uint)vstart);
-	for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+	for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+		kmem.ref[V2P(p)/PGSIZE] = 1;
 		kfree(p);
+	}
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(char *v)
 {
@@ -64,6 +71,9 @@ kfree(char *v)
 	if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
 		panic("kfree");
 
+	if(kderef(v))
+		return;
+
 	// Fill with junk to catch dangling refs.
 	memset(v, 1, PGSIZE);
 
@@ -87,10 +97,53 @@ kalloc(void)
 	if(kmem.use_lock)
 		acquire(&kmem.lock);
 	r = kmem.freelist;
-	if(r)
+	if(r){
 		kmem.freelist = r->next;
+		kmem.ref[V2P(r)/PGSIZE] = 1;
+	}
 	if(kmem.use_lock)
 		release(&kmem.lock);
 	return (char*)r;
 }
 
+// Add a reference to the allocated page at v.
+void
+kref(char *v)
+{
+	if(kmem.use_lock)
+		acquire(&kmem.lock);
+	if(kmem.ref[V2P(v)/PGSIZE] == 0)
+		panic("kref");
+	kmem.ref[V2P(v)/PGSIZE]++;
+	if(kmem.use_lock)
+		release(&kmem.lock);
+}
+
+// Return whether more than one holder shares the page at v.
+int
+kshared(char *v)
+{
+	return kmem.ref[V2P(v)/PGSIZE] > 1;
+}
+
+// Drop a reference to the page at v unless it is the
+// last one.  Return 1 if others still hold the page,
+// 0 if the caller holds the only reference and must
+// free the page itself.
+int
+kderef(char *v)
+{
+	int shared;
+
+	if(kmem.use_lock)
+		acquire(&kmem.lock);
+	shared = kmem.ref[V2P(v)/PGSIZE] > 1;
+	if(shared)
+		kmem.ref[V2P(v)/PGSIZE]--;
+	else
+		kmem.ref[V2P(v)/PGSIZE] = 0;
+	if(kmem.use_lock)
+		release(&kmem.lock);
+	return shared;
+}
+
@@ -9,6 +9,8 @@
 #include "traps.h"
 #include "mmu.h"
 #include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
 
 // Local APIC registers, divided by 4 for use as uint[] indices.
 #define ID      (0x0020/4)   // ID
@@ -31,7 +33,7 @@
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
 	#define X1         0x0000000B   // divide counts by 1
-	#define PERIODIC   0x00020000   // Periodic
+	#define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -41,7 +43,20 @@
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
+// 8253 programmable interval timer, used as the
+// reference clock to calibrate the LAPIC timer and TSC.
+#define PIT_HZ    1193182
+#define PIT_CH2   0x42         // Channel 2 data
+#define PIT_MODE  0x43         // Mode/command
+#define PIT_GATE  0x61         // Channel 2 gate (bit 0) and output (bit 5)
+#define CALMS     10           // Calibration period (milliseconds)
+
 volatile uint *lapic;  // Initialized in mp.c
+uint lapicmhz;         // LAPIC timer counts per microsecond
+uint tscmhz;           // TSC cycles per microsecond
+static uint tickcycles; // TSC cycles per clock tick
+
+static void lapiccalibrate(void);
 
 static void
 lapicw(int index, int value)
@@ -59,13 +74,16 @@ lapicinit(void)
 	// Enable local APIC; set spurious interrupt vector.
 	lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.
-	// If xv6 cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// The timer counts down at bus frequency from lapic[TICR]
+	// and then issues an interrupt.  It runs in one-shot mode,
+	// armed by lapicarm for the next clock tick or the end of
+	// the running process's time slice, whichever is first.
 	lapicw(TDCR, X1);
-	lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-	lapicw(TICR, 10000000);
+	if(tscmhz == 0)
+		lapiccalibrate();
+	mycpu()->nexttick = rdtsc() + tickcycles;
+	lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+	lapicarm();
 
 	// Disable logical interrupt lines.
 	lapicw(LINT0, MASKED);
@@ -96,6 +114,79 @@ lapicinit(void)
 	lapicw(TPR, 0);
 }
 
+// Measure the LAPIC timer and TSC rates against
+// CALMS milliseconds of PIT channel 2.
+static void
+lapiccalibrate(void)
+{
+	uint n, t0, t1, gate;
+
+	n = PIT_HZ / 1000 * CALMS;
+	gate = inb(PIT_GATE) & ~0x02;   // speaker off
+	outb(PIT_GATE, gate & ~0x01);
+	outb(PIT_MODE, 0xB0);           // channel 2, lo/hi byte, mode 0
+	outb(PIT_CH2, n & 0xFF);
+	outb(PIT_CH2, n >> 8);
+
+	lapicw(TIMER, MASKED | ONESHOT | (T_IRQ0 + IRQ_TIMER));
+	lapicw(TICR, 0xFFFFFFFF);
+	t0 = rdtsc();
+	outb(PIT_GATE, gate | 0x01);    // start counting
+	while((inb(PIT_GATE) & 0x20) == 0)
+		;
+	t1 = rdtsc();
+	n = 0xFFFFFFFF - lapic[TCCR];
+	lapicw(TICR, 0);
+
+	lapicmhz = n / (CALMS*1000);
+	tscmhz = (t1 - t0) / (CALMS*1000);
+	if(lapicmhz == 0)
+		lapicmhz = 1;
+	if(tscmhz == 0)
+		tscmhz = 1;
+	tickcycles = TICKUS * tscmhz;
+	cprintf("lapic: timer %d MHz, tsc %d MHz\n", lapicmhz, tscmhz);
+}
+
+// Arm this CPU's timer for its next clock tick, or for the
+// end of the running process's time slice if that is sooner.
+// Interrupts must be disabled.
+void
+lapicarm(void)
+{
+	struct cpu *c;
+	uint now;
+	int d;
+
+	if(!lapic)
+		return;
+	c = mycpu();
+	now = rdtsc();
+	d = c->nexttick - now;
+	if(c->proc && (int)(c->sliceend - now) < d)
+		d = c->sliceend - now;
+	d /= (int)tscmhz;
+	if(d < 1)
+		d = 1;
+	lapicw(TICR, d * lapicmhz);
+}
+
+// Return the number of clock ticks that have passed on
+// this CPU since the last call.  Interrupts must be disabled.
+int
+lapicticks(void)
+{
+	struct cpu *c;
+	uint now;
+	int n;
+
+	c = mycpu();
+	now = rdtsc();
+	for(n = 0; (int)(now - c->nexttick) >= 0; n++)
+		c->nexttick += tickcycles;
+	return n;
+}
+
 int
 lapicid(void)
 {
@@ -112,11 +203,45 @@ lapiceoi(void)
 		lapicw(EOI, 0);
 }
 
+// Stop this CPU's timer while it idles (tickless),
+// or restart it.
+void
+lapictickless(int stop)
+{
+	if(!lapic)
+		return;
+	if(stop){
+		lapicw(TIMER, MASKED | ONESHOT | (T_IRQ0 + IRQ_TIMER));
+		lapicw(TICR, 0);
+	} else {
+		mycpu()->nexttick = rdtsc() + tickcycles;
+		lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+		lapicarm();
+	}
+}
+
+// Send an IRQ_WAKEUP interrupt to the CPU with the given
+// APIC id.  Must be called with interrupts disabled.
+void
+lapicwakeup(int apicid)
+{
+	if(!lapic)
+		return;
+	lapicw(ICRHI, apicid<<24);
+	lapicw(ICRLO, FIXED | ASSERT | (T_IRQ0 + IRQ_WAKEUP));
+	while(lapic[ICRLO] & DELIVS)
+		;
+}
+
 // Spin for a given number of microseconds.
-// On real hardware would want to tune this dynamically.
 void
 microdelay(int us)
 {
+	uint t0;
+
+	t0 = rdtsc();
+	while(rdtsc() - t0 < us * tscmhz)
+		;
 }
 
 #define CMOS_PORT    0x70
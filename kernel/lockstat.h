@@ -0,0 +1,14 @@
+#define LOCKNAME 16  // significant characters of a lock name
+
+// Special first arguments to lockstat()
+#define LOCKSTAT_RESET  -1   // zero all the counters
+#define LOCKSTAT_BENCH  -2   // return cycles per acquire/release pair
+
+// Contention counters for the spin locks of one name,
+// summed over all CPUs, as returned by lockstat().
+struct lockstat {
+	char name[LOCKNAME];
+	uint nacquire;   // acquisitions
+	uint ncontend;   // acquisitions that had to wait
+	uint64 spin;     // TSC cycles spent waiting
+};
@@ -19,6 +19,9 @@
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// begin_op() reserves MAXOPBLOCKS log blocks; an operation
+// that knows it needs more, like a large write(), reserves
+// exactly what it needs with begin_opn()/end_opn().
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -41,6 +44,7 @@ struct log {
 	int start;
 	int size;
 	int outstanding; // how many FS sys calls are executing.
+	int reserved;    // log blocks reserved by outstanding calls.
 	int committing;  // in commit(), please wait.
 	int dev;
 	struct logheader lh;
@@ -125,30 +129,49 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+	begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+	end_opn(MAXOPBLOCKS);
+}
+
+// Start an FS operation that writes at most n blocks.
+void
+begin_opn(int n)
+{
+	if(n > LOGSIZE)
+		panic("begin_opn: too big");
+
 	acquire(&log.lock);
 	while(1){
 		if(log.committing){
 			sleep(&log, &log.lock);
-		} else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+		} else if(log.lh.n + log.reserved + n > LOGSIZE){
 			// this op might exhaust log space; wait for commit.
 			sleep(&log, &log.lock);
 		} else {
 			log.outstanding += 1;
+			log.reserved += n;
 			release(&log.lock);
 			break;
 		}
 	}
 }
 
-// called at the end of each FS system call.
+// End an FS operation started with begin_opn(n).
 // commits if this was the last outstanding operation.
 void
-end_op(void)
+end_opn(int n)
 {
 	int do_commit = 0;
 
 	acquire(&log.lock);
 	log.outstanding -= 1;
+	log.reserved -= n;
 	if(log.committing)
 		panic("log.committing");
 	if(log.outstanding == 0){
@@ -156,7 +179,7 @@ end_op(void)
 		log.committing = 1;
 	} else {
 		// begin_op() may be waiting for log space,
-		// and decrementing log.outstanding has decreased
+		// and decrementing log.reserved has decreased
 		// the amount of reserved space.
 		wakeup(&log);
 	}
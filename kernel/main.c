@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -28,8 +29,12 @@ main(void)
 	uartinit();      // serial port
 	pinit();         // process table
 	tvinit();        // trap vectors
+	timerinit();     // timer wheel
+	futexinit();     // user-space wait channels
 	binit();         // buffer cache
+	dcacheinit();    // directory entry cache
 	fileinit();      // file table
+	icacheinit();    // inode cache
 	ideinit();       // disk
 	startothers();   // start other processors
 	kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -8,6 +8,10 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// Read-only pages user code can read kernel data from; see vdso.h
+#define VDSO     0xFDFFE000         // shared by every process
+#define VDSOPROC 0xFDFFF000         // one per address space
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
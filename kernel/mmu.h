@@ -2,6 +2,7 @@
 // x86 memory management unit (MMU).
 
 // Eflags register
+#define FL_TF           0x00000100      // Trap Flag
 #define FL_IF           0x00000200      // Interrupt Enable
 
 // Control Register flags
@@ -103,6 +104,10 @@
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
+#define PTE_COW         0x200   // Copy-on-write (available to software)
+
+// Page fault error code bits.
+#define FEC_WR          0x002   // Fault was caused by a write
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -1,14 +1,20 @@
-#define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         4  // scheduling priority levels, 0 is highest
+#define BOOSTTICKS  100  // default ticks between priority boosts
+#define QUANTUM   10000  // default time slice at top priority (microseconds)
+#define TICKUS    10000  // microseconds per clock tick
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of the i-node cache
+#define NDENTRY     128  // size of directory entry cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#ifndef LOGSIZE
+#define LOGSIZE      (MAXOPBLOCKS*6)  // max data blocks in on-disk log
+#endif
+#define NBUF         (LOGSIZE+MAXOPBLOCKS)  // size of disk block cache
+#define FSSIZE       2000  // size of file system in blocks
 
@@ -2,23 +2,109 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// The ring buffer is made of whole pages, which need not be
+// contiguous.  Data moves through it with memmove, one run
+// of bytes up to the next page boundary at a time.
+//
+// Whole, page-aligned pages move without copying: a writer
+// lends its page to the ring in place of the ring's own,
+// and a reader swaps its page for the ring's, with both
+// sides mapped copy-on-write (see vmlend and vmremap).
+// So a ring page may be shared, and must be replaced with
+// a private one before the ring writes into it, which waits
+// until the reader has drained the whole page.
+//
+// Only the writer moves nwrite and only the reader moves
+// nread, so the two sides run without a shared lock.
+// wlock and rlock order writers among themselves and
+// readers among themselves; with one of each they are
+// never contended.  p->lock is taken only to sleep, to
+// wake a side that is known to be asleep, and to close.
+// pipesize holds all three, wlock first, then rlock, then
+// lock, to change the ring under both sides.
+#define PIPEPAGES 1    // default size, in pages
+#define PIPEMAXPAGES 16
 
 struct pipe {
 	struct spinlock lock;
-	char data[PIPESIZE];
-	uint nread;     // number of bytes read
-	uint nwrite;    // number of bytes written
+	char *page[PIPEMAXPAGES];
+	uint size;      // ring size in bytes, a multiple of PGSIZE
 	int readopen;   // read fd is still open
 	int writeopen;  // write fd is still open
+	int rwait;      // readers asleep, protected by lock
+	int wwait;      // writers asleep, protected by lock
+
+	// Each side on its own cache line.
+	struct spinlock wlock __attribute__((aligned(64)));
+	uint nwrite;    // number of bytes written
+	struct spinlock rlock __attribute__((aligned(64)));
+	uint nread;     // number of bytes read
 };
 
+// Return a pointer to byte off of the ring made of page[]
+// with size bytes, and in *n the number of bytes that are
+// contiguous from there.
+static char*
+ringptr(char **page, uint size, uint off, uint *n)
+{
+	off %= size;
+	*n = PGSIZE - off % PGSIZE;
+	return page[off / PGSIZE] + off % PGSIZE;
+}
+
+// Return the free space in the ring.  A shared page at
+// nwrite counts as full until none of it is left to read.
+static uint
+ringroom(struct pipe *p)
+{
+	uint room;
+
+	room = p->nread + p->size - p->nwrite;
+	if(room < PGSIZE && kshared(p->page[p->nwrite % p->size / PGSIZE]))
+		return 0;
+	return room;
+}
+
+// Make the ring page *pg private to the ring.
+static int
+ringown(char **pg)
+{
+	char *mem;
+
+	if(!kshared(*pg))
+		return 0;
+	if((mem = kalloc()) == 0)
+		return -1;
+	kfree(*pg);
+	*pg = mem;
+	return 0;
+}
+
+// Whether n bytes at user address addr and ring offset off
+// can move by remapping a page.  Not for processes with
+// threads, since other CPUs may cache the old mapping.
+static int
+canremap(char *addr, uint off, int n)
+{
+	return (uint)addr % PGSIZE == 0 && off % PGSIZE == 0 && n >= PGSIZE &&
+		!kshared((char*)myproc()->pgdir);
+}
+
+static void
+freepages(char **page, int npages)
+{
+	int i;
+
+	for(i = 0; i < npages; i++)
+		kfree(page[i]);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,11 +116,17 @@ pipealloc(struct file **f0, struct file **f1)
 		goto bad;
 	if((p = (struct pipe*)kalloc()) == 0)
 		goto bad;
+	memset(p, 0, sizeof(*p));
+	for(p->size = 0; p->size < PIPEPAGES*PGSIZE; p->size += PGSIZE)
+		if((p->page[p->size / PGSIZE] = kalloc()) == 0)
+			goto bad;
 	p->readopen = 1;
 	p->writeopen = 1;
 	p->nwrite = 0;
 	p->nread = 0;
 	initlock(&p->lock, "pipe");
+	initlock(&p->wlock, "pipewrite");
+	initlock(&p->rlock, "piperead");
 	(*f0)->type = FD_PIPE;
 	(*f0)->readable = 1;
 	(*f0)->writable = 0;
@@ -46,8 +138,10 @@ pipealloc(struct file **f0, struct file **f1)
 	return 0;
 
 	bad:
-	if(p)
+	if(p){
+		freepages(p->page, p->size / PGSIZE);
 		kfree((char*)p);
+	}
 	if(*f0)
 		fileclose(*f0);
 	if(*f1)
@@ -68,30 +162,103 @@ pipeclose(struct pipe *p, int writable)
 	}
 	if(p->readopen == 0 && p->writeopen == 0){
 		release(&p->lock);
+		freepages(p->page, p->size / PGSIZE);
 		kfree((char*)p);
 	} else
 		release(&p->lock);
 }
 
+// Sleep on chan until ready(p) or the other side closes
+// or the process is killed, with *side released meanwhile.
+// *nwait counts the sleepers, so the other side knows to
+// wake them.  Returns -1 if killed.
+static int
+pipewait(struct pipe *p, struct spinlock *side, void *chan, int *nwait,
+	 int (*ready)(struct pipe*))
+{
+	int killed;
+
+	release(side);
+	acquire(&p->lock);
+	(*nwait)++;
+	// Publish *nwait before the last look at the other
+	// side's index, which it moves before looking at *nwait.
+	__sync_synchronize();
+	while(!ready(p) && !myproc()->killed)
+		sleep(chan, &p->lock);
+	(*nwait)--;
+	killed = myproc()->killed;
+	release(&p->lock);
+	acquire(side);
+	return killed ? -1 : 0;
+}
+
+// Wake the sleepers on chan if *nwait says there are any.
+static void
+pipewake(struct pipe *p, void *chan, int *nwait)
+{
+	__sync_synchronize();
+	if(*nwait == 0)
+		return;
+	acquire(&p->lock);
+	wakeup(chan);
+	release(&p->lock);
+}
+
+static int
+canwrite(struct pipe *p)
+{
+	return ringroom(p) != 0 || p->readopen == 0;
+}
+
+static int
+canread(struct pipe *p)
+{
+	return p->nread != p->nwrite || p->writeopen == 0;
+}
+
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
 	int i;
+	uint m, room;
+	char *dst, **pg;
 
-	acquire(&p->lock);
-	for(i = 0; i < n; i++){
-		while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
-			if(p->readopen == 0 || myproc()->killed){
-				release(&p->lock);
+	acquire(&p->wlock);
+	for(i = 0; i < n; i += m){
+		while((room = ringroom(p)) == 0){  //DOC: pipewrite-full
+			pipewake(p, &p->nread, &p->rwait);
+			if(p->readopen == 0 ||
+			   pipewait(p, &p->wlock, &p->nwrite, &p->wwait, canwrite) < 0){
+				release(&p->wlock);
+				return -1;
+			}
+		}
+		__sync_synchronize();  // the reader is done with what it freed
+		pg = &p->page[p->nwrite % p->size / PGSIZE];
+		if(room >= PGSIZE && canremap(addr + i, p->nwrite, n - i) &&
+		   (dst = vmlend(myproc()->pgdir, addr + i)) != 0){
+			// Lend the writer's page to the ring.
+			kfree(*pg);
+			*pg = dst;
+			m = PGSIZE;
+		} else {
+			if(ringown(pg) < 0){
+				release(&p->wlock);
 				return -1;
 			}
-			wakeup(&p->nread);
-			sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+			dst = ringptr(p->page, p->size, p->nwrite, &m);
+			if(m > room)
+				m = room;
+			if(m > n - i)
+				m = n - i;
+			memmove(dst, addr + i, m);
 		}
-		p->data[p->nwrite++ % PIPESIZE] = addr[i];
+		__sync_synchronize();  // data before nwrite moves past it
+		p->nwrite += m;
 	}
-	wakeup(&p->nread);  //DOC: pipewrite-wakeup1
-	release(&p->lock);
+	pipewake(p, &p->nread, &p->rwait);  //DOC: pipewrite-wakeup1
+	release(&p->wlock);
 	return n;
 }
 
@@ -99,21 +266,98 @@ int
 piperead(struct pipe *p, char *addr, int n)
 {
 	int i;
+	uint m, nwrite;
+	char *src, **pg;
 
-	acquire(&p->lock);
+	acquire(&p->rlock);
 	while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-		if(myproc()->killed){
-			release(&p->lock);
+		if(pipewait(p, &p->rlock, &p->nread, &p->rwait, canread) < 0){
+			release(&p->rlock);
 			return -1;
 		}
-		sleep(&p->nread, &p->lock); //DOC: piperead-sleep
 	}
-	for(i = 0; i < n; i++){  //DOC: piperead-copy
-		if(p->nread == p->nwrite)
+	for(i = 0; i < n; i += m){  //DOC: piperead-copy
+		if((nwrite = p->nwrite) == p->nread)
 			break;
-		addr[i] = p->data[p->nread++ % PIPESIZE];
+		__sync_synchronize();  // the writer is done with what it filled
+		pg = &p->page[p->nread % p->size / PGSIZE];
+		if(nwrite - p->nread >= PGSIZE &&
+		   canremap(addr + i, p->nread, n - i) &&
+		   (src = vmremap(myproc()->pgdir, addr + i, *pg)) != 0){
+			// Swap the reader's page for the ring's.
+			*pg = src;
+			m = PGSIZE;
+		} else {
+			src = ringptr(p->page, p->size, p->nread, &m);
+			if(m > nwrite - p->nread)
+				m = nwrite - p->nread;
+			if(m > n - i)
+				m = n - i;
+			memmove(addr + i, src, m);
+		}
+		__sync_synchronize();  // done with the data before nread moves
+		p->nread += m;
 	}
-	wakeup(&p->nwrite);  //DOC: piperead-wakeup
-	release(&p->lock);
+	pipewake(p, &p->nwrite, &p->wwait);  //DOC: piperead-wakeup
+	release(&p->rlock);
 	return i;
 }
+
+// Resize the ring to hold at least n bytes, rounded up to
+// whole pages; n == 0 leaves it alone.  Fails if the bytes
+// already in the pipe would not fit.  Returns the size.
+int
+pipesize(struct pipe *p, int n)
+{
+	char *page[PIPEMAXPAGES], *old[PIPEMAXPAGES];
+	char *src, *dst;
+	uint size, oldsize, off, cnt, m, m1;
+	int i;
+
+	if(n == 0)
+		return p->size;
+	if(n < 0 || n > PIPEMAXPAGES*PGSIZE)
+		return -1;
+	size = PGROUNDUP(n);
+	for(i = 0; i < size / PGSIZE; i++){
+		if((page[i] = kalloc()) == 0){
+			freepages(page, i);
+			return -1;
+		}
+	}
+
+	acquire(&p->wlock);
+	acquire(&p->rlock);
+	acquire(&p->lock);
+	cnt = p->nwrite - p->nread;
+	if(cnt > size){
+		release(&p->lock);
+		release(&p->rlock);
+		release(&p->wlock);
+		freepages(page, size / PGSIZE);
+		return -1;
+	}
+	// Copy what is buffered to the start of the new ring.
+	for(off = 0; off < cnt; off += m){
+		src = ringptr(p->page, p->size, p->nread + off, &m);
+		dst = ringptr(page, size, off, &m1);
+		if(m > m1)
+			m = m1;
+		if(m > cnt - off)
+			m = cnt - off;
+		memmove(dst, src, m);
+	}
+	oldsize = p->size;
+	memmove(old, p->page, sizeof(old));
+	memmove(p->page, page, sizeof(page));
+	p->size = size;
+	p->nread = 0;
+	p->nwrite = cnt;
+	wakeup(&p->nwrite);
+	release(&p->lock);
+	release(&p->rlock);
+	release(&p->wlock);
+
+	freepages(old, oldsize / PGSIZE);
+	return size;
+}
@@ -4,26 +4,237 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "proc.h"
+#include "sysctl.h"
+
+// Proc structures are carved out of kalloc'd pages as
+// needed and never given back, so the number of processes
+// is limited only by memory.  ptable.lock protects the
+// free list, the pid hash, p->parent and the child lists,
+// and must be acquired before any p->lock.  Changes to
+// the pid hash and the list of all procs also hold
+// pidlock for writing, so that kill, setpriority and
+// boost can look up or walk procs holding only pidlock
+// for reading, without serializing with one another.
+// pidlock comes after ptable.lock and before p->lock.
+// p->lock protects p->state and p->killed; the
+// scheduler holds it across the switch into p.
+#define NPIDHASH 61
+#define PIDHASH(pid) ((uint)(pid) % NPIDHASH)
 
 struct {
 	struct spinlock lock;
-	struct proc proc[NPROC];
+	struct rwlock pidlock;
+	struct proc *all;            // Every proc structure, by p->anext
+	struct proc *free;           // UNUSED ones, by p->pidnext
+	struct proc *pid[NPIDHASH];  // The rest, by p->pidnext
 } ptable;
 
+// Per-CPU run queues of RUNNABLE processes, one
+// FIFO per priority level (multilevel feedback queue).
+// A process is queued on the CPU it last ran on;
+// a CPU whose own queue is empty steals from the
+// longest other queue.  p->lock is held when
+// rq->lock is acquired.
+struct runq {
+	struct spinlock lock;
+	struct proc *head[NPRIO];
+	struct proc *tail[NPRIO];
+	volatile int n;              // Read without lock as a hint
+} runq[NCPU];
+
+// Wait queues of SLEEPING processes, hashed by channel,
+// so that wakeup only looks at processes that may be
+// sleeping on its channel.  wq->lock protects the list
+// and p->chan, and is acquired before p->lock.
+#define NWAITQ 61
+#define WQHASH(chan) (((uint)(chan) >> 2) % NWAITQ)
+
+struct waitq {
+	struct spinlock lock;
+	struct proc *head;
+} waitq[NWAITQ];
+
 static struct proc *initproc;
 
+uint quantum = QUANTUM;
+uint boostticks = BOOSTTICKS;
+
+// Microseconds a process may run at priority level
+// pri before it moves down a level.
+#define TIMESLICE(pri)  (quantum << (pri))
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void runqappend(struct runq*, struct proc*);
+static void kick(int);
+static int startchild(struct proc*);
+static int reap(int, uint*);
 
 void
 pinit(void)
 {
+	struct runq *rq;
+	struct waitq *wq;
+
 	initlock(&ptable.lock, "ptable");
+	initrwlock(&ptable.pidlock, "pidlock");
+	for(rq = runq; rq < &runq[NCPU]; rq++)
+		initlock(&rq->lock, "runq");
+	for(wq = waitq; wq < &waitq[NWAITQ]; wq++)
+		initlock(&wq->lock, "waitq");
+}
+
+// Append p to the run queue of the CPU it last ran on.
+// Caller must hold p->lock and have made p RUNNABLE.
+static void
+runqput(struct proc *p)
+{
+	struct runq *rq;
+
+	rq = &runq[p->cpu];
+	acquire(&rq->lock);
+	runqappend(rq, p);
+	rq->n++;
+	release(&rq->lock);
+	kick(p->cpu);
+}
+
+// Make sure a CPU will notice new work on cpu id's
+// queue: interrupt that CPU if it is idle, otherwise
+// any idle CPU, which will steal the work.
+// Interrupts must be disabled.
+static void
+kick(int id)
+{
+	struct cpu *c;
+
+	if(cpus[id].idle){
+		lapicwakeup(cpus[id].apicid);
+		return;
+	}
+	for(c = cpus; c < &cpus[ncpu]; c++){
+		if(c->idle){
+			lapicwakeup(c->apicid);
+			return;
+		}
+	}
+}
+
+// Halt this CPU until an interrupt arrives.  All but
+// the boot CPU, which keeps ticks, also stop their
+// timer while idle; kick wakes them when there is work.
+static void
+idle(struct cpu *c)
+{
+	struct runq *rq;
+	int id;
+
+	id = c - cpus;
+	cli();
+	c->idle = 1;
+
+	// A runqput either sees c->idle and kicks us,
+	// or its work is visible to this check.
+	__sync_synchronize();
+	for(rq = runq; rq < &runq[ncpu]; rq++)
+		if(rq->n > 0)
+			goto out;
+
+	if(id != 0)
+		lapictickless(1);
+	stihlt();
+	cli();
+	if(id != 0)
+		lapictickless(0);
+out:
+	c->idle = 0;
+}
+
+// Append p to rq's list for its priority.
+// Caller must hold rq->lock.
+static void
+runqappend(struct runq *rq, struct proc *p)
+{
+	int pri;
+
+	pri = p->priority;
+	p->rqnext = 0;
+	if(rq->tail[pri])
+		rq->tail[pri]->rqnext = p;
+	else
+		rq->head[pri] = p;
+	rq->tail[pri] = p;
+}
+
+// Set RUNNABLE p's priority to pri and, if it is still
+// queued, move it to the tail of that level.
+// Caller must hold p->lock.
+static void
+runqmove(struct proc *p, int pri)
+{
+	struct runq *rq;
+	struct proc **pp, *prev;
+	int old;
+
+	rq = &runq[p->cpu];
+	acquire(&rq->lock);
+	old = p->priority;
+	p->priority = pri;
+	prev = 0;
+	for(pp = &rq->head[old]; *pp && *pp != p; pp = &(*pp)->rqnext)
+		prev = *pp;
+	if(*pp == p){
+		*pp = p->rqnext;
+		if(rq->tail[old] == p)
+			rq->tail[old] = prev;
+		runqappend(rq, p);
+	}
+	release(&rq->lock);
+}
+
+// Remove and return the first process of the
+// highest non-empty priority on rq, or 0.
+static struct proc*
+runqget(struct runq *rq)
+{
+	struct proc *p;
+	int pri;
+
+	if(rq->n == 0)
+		return 0;
+	p = 0;
+	acquire(&rq->lock);
+	for(pri = 0; pri < NPRIO; pri++){
+		if((p = rq->head[pri]) != 0){
+			rq->head[pri] = p->rqnext;
+			if(rq->head[pri] == 0)
+				rq->tail[pri] = 0;
+			rq->n--;
+			break;
+		}
+	}
+	release(&rq->lock);
+	return p;
+}
+
+// Take a process from the busiest other CPU's queue.
+static struct proc*
+runqsteal(int self)
+{
+	struct runq *rq, *busiest;
+
+	busiest = 0;
+	for(rq = runq; rq < &runq[ncpu]; rq++)
+		if(rq != &runq[self] && rq->n > 0 && (busiest == 0 || rq->n > busiest->n))
+			busiest = rq;
+	if(busiest == 0)
+		return 0;
+	return runqget(busiest);
 }
 
 // Must be called with interrupts disabled
@@ -67,10 +278,73 @@ myproc(void)
 	return p;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Carve a page into proc structures for the free list.
+// Caller must hold ptable.lock.
+static int
+procgrow(void)
+{
+	struct proc *p;
+	char *mem;
+
+	if((mem = kalloc()) == 0)
+		return -1;
+	memset(mem, 0, PGSIZE);
+	acquirewrite(&ptable.pidlock);
+	for(p = (struct proc*)mem; p+1 <= (struct proc*)(mem + PGSIZE); p++){
+		initlock(&p->lock, "proc");
+		p->anext = ptable.all;
+		ptable.all = p;
+		p->pidnext = ptable.free;
+		ptable.free = p;
+	}
+	releasewrite(&ptable.pidlock);
+	return 0;
+}
+
+// Return the process with the given pid, or 0.
+// Caller must hold ptable.lock or ptable.pidlock.
+static struct proc*
+findproc(int pid)
+{
+	struct proc *p;
+
+	for(p = ptable.pid[PIDHASH(pid)]; p; p = p->pidnext)
+		if(p->pid == pid)
+			return p;
+	return 0;
+}
+
+// Unhash p and put it back on the free list.
+// Caller must hold ptable.lock.
+static void
+procfree(struct proc *p)
+{
+	struct proc **pp;
+
+	acquirewrite(&ptable.pidlock);
+	for(pp = &ptable.pid[PIDHASH(p->pid)]; *pp; pp = &(*pp)->pidnext){
+		if(*pp == p){
+			*pp = p->pidnext;
+			break;
+		}
+	}
+	p->pid = 0;
+	p->parent = 0;
+	p->children = 0;
+	p->sibling = 0;
+	p->thread = 0;
+	p->name[0] = 0;
+	p->killed = 0;
+	p->state = UNUSED;
+	p->pidnext = ptable.free;
+	ptable.free = p;
+	releasewrite(&ptable.pidlock);
+}
+
+// Take an UNUSED proc off the free list, growing the
+// pool if it is empty.  If found, change state to
+// EMBRYO and initialize state required to run in
+// the kernel.  Otherwise return 0.
 static struct proc*
 allocproc(void)
 {
@@ -79,22 +353,31 @@ allocproc(void)
 
 	acquire(&ptable.lock);
 
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-		if(p->state == UNUSED)
-			goto found;
-
-	release(&ptable.lock);
-	return 0;
+	if(ptable.free == 0 && procgrow() < 0){
+		release(&ptable.lock);
+		return 0;
+	}
+	p = ptable.free;
+	ptable.free = p->pidnext;
 
-found:
+	acquirewrite(&ptable.pidlock);
 	p->state = EMBRYO;
 	p->pid = nextpid++;
+	p->pidnext = ptable.pid[PIDHASH(p->pid)];
+	ptable.pid[PIDHASH(p->pid)] = p;
+	releasewrite(&ptable.pidlock);
+	p->cpu = cpuid();
+	p->basepri = 0;
+	p->priority = 0;
+	p->used = 0;
 
 	release(&ptable.lock);
 
 	// Allocate kernel stack.
 	if((p->kstack = kalloc()) == 0){
-		p->state = UNUSED;
+		acquire(&ptable.lock);
+		procfree(p);
+		release(&ptable.lock);
 		return 0;
 	}
 	sp = p->kstack + KSTACKSIZE;
@@ -129,6 +412,7 @@ userinit(void)
 	if((p->pgdir = setupkvm()) == 0)
 		panic("userinit: out of memory?");
 	inituvm(p->pgdir, _binary_user_initcode_start, (int)_binary_user_initcode_size);
+	vdsosetpid(p->pgdir, p->pid);
 	p->sz = PGSIZE;
 	memset(p->tf, 0, sizeof(*p->tf));
 	p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
@@ -146,32 +430,49 @@ userinit(void)
 	// run this process. the acquire forces the above
 	// writes to be visible, and the lock is also needed
 	// because the assignment might not be atomic.
-	acquire(&ptable.lock);
+	acquire(&p->lock);
 
 	p->state = RUNNABLE;
+	runqput(p);
 
-	release(&ptable.lock);
+	release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size, or -1 on failure.
+// Threads sharing the address space grow with it; ptable.lock
+// keeps their sizes in step.  Other CPUs may hold stale TLB
+// entries for a thread, so a shared address space cannot shrink.
 int
 growproc(int n)
 {
-	uint sz;
+	uint sz, oldsz;
 	struct proc *curproc = myproc();
+	struct proc *p;
+	int shared;
 
-	sz = curproc->sz;
+	acquire(&ptable.lock);
+	shared = kshared((char*)curproc->pgdir);
+	oldsz = sz = curproc->sz;
 	if(n > 0){
 		if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			return -1;
+			goto bad;
 	} else if(n < 0){
-		if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			return -1;
+		if(shared || (sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+			goto bad;
 	}
 	curproc->sz = sz;
+	if(shared)
+		for(p = ptable.all; p; p = p->anext)
+			if(p->pgdir == curproc->pgdir && p->state != UNUSED)
+				p->sz = sz;
+	release(&ptable.lock);
 	switchuvm(curproc);
-	return 0;
+	return oldsz;
+
+bad:
+	release(&ptable.lock);
+	return -1;
 }
 
 // Create a new process copying p as the parent.
@@ -180,7 +481,6 @@ growproc(int n)
 int
 fork(void)
 {
-	int i, pid;
 	struct proc *np;
 	struct proc *curproc = myproc();
 
@@ -193,16 +493,32 @@ fork(void)
 	if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
 		kfree(np->kstack);
 		np->kstack = 0;
-		np->state = UNUSED;
+		acquire(&ptable.lock);
+		procfree(np);
+		release(&ptable.lock);
 		return -1;
 	}
+	vdsosetpid(np->pgdir, np->pid);
 	np->sz = curproc->sz;
-	np->parent = curproc;
 	*np->tf = *curproc->tf;
 
 	// Clear %eax so that fork returns 0 in the child.
 	np->tf->eax = 0;
 
+	return startchild(np);
+}
+
+// Give np copies of the current process's files and make
+// it a RUNNABLE child of the current process.  Return its pid.
+static int
+startchild(struct proc *np)
+{
+	int i, pid;
+	struct proc *curproc = myproc();
+
+	np->basepri = curproc->basepri;
+	np->priority = np->basepri;
+
 	for(i = 0; i < NOFILE; i++)
 		if(curproc->ofile[i])
 			np->ofile[i] = filedup(curproc->ofile[i]);
@@ -213,14 +529,71 @@ fork(void)
 	pid = np->pid;
 
 	acquire(&ptable.lock);
+	np->parent = curproc;
+	np->sibling = curproc->children;
+	curproc->children = np;
+	release(&ptable.lock);
+
+	acquire(&np->lock);
 
 	np->state = RUNNABLE;
+	runqput(np);
 
-	release(&ptable.lock);
+	release(&np->lock);
 
 	return pid;
 }
 
+// Create a thread: a child process that shares the current
+// process's address space and starts in fn(arg) on the
+// page-aligned user stack page at stack.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+	struct proc *np;
+	struct proc *curproc = myproc();
+	uint sp, ustack[2];
+
+	if((uint)stack % PGSIZE || (uint)stack >= curproc->sz ||
+	   (uint)stack + PGSIZE > curproc->sz)
+		return -1;
+
+	// Threads must not share copy-on-write pages; see cowbreak.
+	if(cowbreak(curproc->pgdir, curproc->sz) < 0)
+		return -1;
+
+	if((np = allocproc()) == 0)
+		return -1;
+
+	acquire(&ptable.lock);
+	np->pgdir = curproc->pgdir;
+	kref((char*)np->pgdir);
+	vdsosetpid(np->pgdir, 0);
+	np->sz = curproc->sz;
+	release(&ptable.lock);
+	np->thread = 1;
+	np->ustack = (uint)stack;
+
+	// Start at fn(arg), with a fake return PC.
+	*np->tf = *curproc->tf;
+	sp = (uint)stack + PGSIZE - sizeof ustack;
+	ustack[0] = 0xffffffff;
+	ustack[1] = (uint)arg;
+	if(copyout(np->pgdir, sp, ustack, sizeof ustack) < 0){
+		freevm(np->pgdir);
+		kfree(np->kstack);
+		np->kstack = 0;
+		acquire(&ptable.lock);
+		procfree(np);
+		release(&ptable.lock);
+		return -1;
+	}
+	np->tf->esp = sp;
+	np->tf->eip = (uint)fn;
+
+	return startchild(np);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -228,7 +601,7 @@ void
 exit(void)
 {
 	struct proc *curproc = myproc();
-	struct proc *p;
+	struct proc *p, *next;
 	int fd;
 
 	if(curproc == initproc)
@@ -250,19 +623,27 @@ exit(void)
 	acquire(&ptable.lock);
 
 	// Parent might be sleeping in wait().
-	wakeup1(curproc->parent);
-
-	// Pass abandoned children to init.
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		if(p->parent == curproc){
-			p->parent = initproc;
-			if(p->state == ZOMBIE)
-				wakeup1(initproc);
-		}
+	wakeup(curproc->parent);
+
+	// Pass abandoned children to init.  A child only
+	// becomes ZOMBIE while holding ptable.lock.
+	for(p = curproc->children; p; p = next){
+		next = p->sibling;
+		p->parent = initproc;
+		p->thread = 0;
+		p->sibling = initproc->children;
+		initproc->children = p;
+		if(p->state == ZOMBIE)
+			wakeup(initproc);
 	}
+	curproc->children = 0;
 
 	// Jump into the scheduler, never to return.
+	// The parent's wait() cannot free us until the
+	// scheduler has released curproc->lock.
+	acquire(&curproc->lock);
 	curproc->state = ZOMBIE;
+	release(&ptable.lock);
 	sched();
 	panic("zombie exit");
 }
@@ -272,32 +653,54 @@ exit(void)
 int
 wait(void)
 {
-	struct proc *p;
+	return reap(0, 0);
+}
+
+// Wait for a child thread to exit and return its pid,
+// storing the stack it was given by clone in *ustack.
+// Return -1 if this process has no child threads.
+int
+join(uint *ustack)
+{
+	return reap(1, ustack);
+}
+
+// Wait for a child thread (if thread) or other child to exit.
+static int
+reap(int thread, uint *ustack)
+{
+	struct proc *p, **pp;
 	int havekids, pid;
 	struct proc *curproc = myproc();
 
 	acquire(&ptable.lock);
 	for(;;){
-		// Scan through table looking for exited children.
+		// Scan through our children looking for exited ones.
 		havekids = 0;
-		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-			if(p->parent != curproc)
+		for(pp = &curproc->children; (p = *pp) != 0; pp = &p->sibling){
+			if(p->thread != thread)
 				continue;
 			havekids = 1;
+			acquire(&p->lock);
 			if(p->state == ZOMBIE){
 				// Found one.
+				*pp = p->sibling;
 				pid = p->pid;
+				if(ustack)
+					*ustack = p->ustack;
 				kfree(p->kstack);
 				p->kstack = 0;
 				freevm(p->pgdir);
-				p->pid = 0;
-				p->parent = 0;
-				p->name[0] = 0;
-				p->killed = 0;
-				p->state = UNUSED;
+				// The last thread is gone; our pid is the
+				// address space's again (see clone).
+				if(thread && !kshared((char*)curproc->pgdir))
+					vdsosetpid(curproc->pgdir, curproc->pid);
+				release(&p->lock);
+				procfree(p);
 				release(&ptable.lock);
 				return pid;
 			}
+			release(&p->lock);
 		}
 
 		// No point waiting if we don't have any children.
@@ -306,7 +709,7 @@ wait(void)
 			return -1;
 		}
 
-		// Wait for children to exit.  (See wakeup1 call in proc_exit.)
+		// Wait for children to exit.  (See wakeup call in exit.)
 		sleep(curproc, &ptable.lock);  //DOC: wait-sleep
 	}
 }
@@ -323,38 +726,51 @@ scheduler(void)
 {
 	struct proc *p;
 	struct cpu *c = mycpu();
+	int id = c - cpus;
+	uint slice;
 	c->proc = 0;
 
 	for(;;){
 		// Enable interrupts on this processor.
 		sti();
 
-		// Loop over process table looking for process to run.
-		acquire(&ptable.lock);
-		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-			if(p->state != RUNNABLE)
-				continue;
+		// Take the next process from our own queue,
+		// or steal one if it is empty.
+		if((p = runqget(&runq[id])) == 0 && (p = runqsteal(id)) == 0){
+			idle(c);
+			continue;
+		}
 
-			// Switch to chosen process.  It is the process's job
-			// to release ptable.lock and then reacquire it
-			// before jumping back to us.
+		// Switch to chosen process.  It is the process's job
+		// to release p->lock and then reacquire it
+		// before jumping back to us.
+		acquire(&p->lock);
+		if(p->state == RUNNABLE){
+			p->cpu = id;
 			c->proc = p;
 			switchuvm(p);
 			p->state = RUNNING;
 
+			// Arm the timer for the rest of p's time slice.
+			slice = TIMESLICE(p->priority);
+			c->slicestart = rdtsc();
+			c->sliceend = c->slicestart +
+				(p->used < slice ? slice - p->used : 0) * tscmhz;
+			lapicarm();
+
 			swtch(&(c->scheduler), p->context);
 			switchkvm();
+			p->used += (rdtsc() - c->slicestart) / tscmhz;
 
 			// Process is done running for now.
 			// It should have changed its p->state before coming back.
 			c->proc = 0;
 		}
-		release(&ptable.lock);
-
+		release(&p->lock);
 	}
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -367,8 +783,8 @@ sched(void)
 	int intena;
 	struct proc *p = myproc();
 
-	if(!holding(&ptable.lock))
-		panic("sched ptable.lock");
+	if(!holding(&p->lock))
+		panic("sched p->lock");
 	if(mycpu()->ncli != 1)
 		panic("sched locks");
 	if(p->state == RUNNING)
@@ -384,10 +800,148 @@ sched(void)
 void
 yield(void)
 {
-	acquire(&ptable.lock);  //DOC: yieldlock
-	myproc()->state = RUNNABLE;
+	struct proc *p = myproc();
+
+	acquire(&p->lock);  //DOC: yieldlock
+	p->state = RUNNABLE;
+	runqput(p);
 	sched();
-	release(&ptable.lock);
+	release(&p->lock);
+}
+
+// Called on a timer interrupt in the current process.
+// Return 1 if it should yield: either it has used up
+// its time slice, and moves down a level, or a process
+// of higher priority is waiting on this CPU.
+int
+schedtick(void)
+{
+	struct proc *p = myproc();
+	struct cpu *c;
+	struct runq *rq;
+	int pri, r;
+
+	r = 0;
+	acquire(&p->lock);
+	c = mycpu();
+	if((int)(rdtsc() - c->sliceend) >= 0){
+		p->used = 0;
+		c->slicestart = rdtsc();
+		if(p->priority < NPRIO-1)
+			p->priority++;
+		r = 1;
+	} else {
+		rq = &runq[p->cpu];
+		for(pri = 0; pri < p->priority; pri++)
+			if(rq->head[pri])
+				r = 1;
+	}
+	release(&p->lock);
+	return r;
+}
+
+// Move every process back to its base priority so that
+// CPU-bound processes that sank to the bottom level are
+// not starved.  Called by the timer every boostticks.
+void
+boost(void)
+{
+	struct proc *p, *q, *next;
+	struct runq *rq;
+	int pri;
+
+	acquireread(&ptable.pidlock);
+	for(p = ptable.all; p; p = p->anext){
+		acquire(&p->lock);
+		p->priority = p->basepri;
+		p->used = 0;
+		release(&p->lock);
+	}
+	releaseread(&ptable.pidlock);
+
+	// Requeue RUNNABLE processes at their new levels.
+	for(rq = runq; rq < &runq[ncpu]; rq++){
+		acquire(&rq->lock);
+		q = 0;
+		for(pri = NPRIO-1; pri >= 0; pri--){
+			if(rq->tail[pri] == 0)
+				continue;
+			rq->tail[pri]->rqnext = q;
+			q = rq->head[pri];
+			rq->head[pri] = rq->tail[pri] = 0;
+		}
+		for(; q; q = next){
+			next = q->rqnext;
+			runqappend(rq, q);
+		}
+		release(&rq->lock);
+	}
+}
+
+// Set the base priority of the process with the given
+// pid and move it to that level.  Return the old base
+// priority, or -1 if there is no such process.
+int
+setpriority(int pid, int pri)
+{
+	struct proc *p;
+	int old;
+
+	if(pri < 0 || pri >= NPRIO)
+		return -1;
+	acquireread(&ptable.pidlock);
+	if((p = findproc(pid)) == 0){
+		releaseread(&ptable.pidlock);
+		return -1;
+	}
+	acquire(&p->lock);
+	old = p->basepri;
+	p->basepri = pri;
+	if(p->state == RUNNABLE)
+		runqmove(p, pri);
+	else
+		p->priority = pri;
+	p->used = 0;
+	release(&p->lock);
+	releaseread(&ptable.pidlock);
+	return old;
+}
+
+// Read a scheduler parameter and, if val >= 0, set it.
+// Return the old value, or -1 for an unknown name
+// or out-of-range value.
+int
+sysctl(int name, int val)
+{
+	uint *v, lo, hi;
+	int old;
+
+	switch(name){
+	case CTL_QUANTUM:
+		v = &quantum;
+		lo = 100;
+		hi = 100000;
+		// Slice deadlines are compared as signed 32-bit TSC
+		// differences, so the longest slice must stay under
+		// 2^31 cycles.
+		if(tscmhz && hi > 0x7fffffff / tscmhz >> (NPRIO-1))
+			hi = 0x7fffffff / tscmhz >> (NPRIO-1);
+		break;
+	case CTL_BOOST:
+		v = &boostticks;
+		lo = 1;
+		hi = 100000;
+		break;
+	default:
+		return -1;
+	}
+	old = *v;
+	if(val >= 0){
+		if(val < lo || val > hi)
+			return -1;
+		*v = val;
+	}
+	return old;
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -396,8 +950,8 @@ void
 forkret(void)
 {
 	static int first = 1;
-	// Still holding ptable.lock from scheduler.
-	release(&ptable.lock);
+	// Still holding p->lock from scheduler.
+	release(&myproc()->lock);
 
 	if (first) {
 		// Some initialization functions must be run in the context
@@ -417,6 +971,8 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
 	struct proc *p = myproc();
+	struct proc **pp;
+	struct waitq *wq;
 
 	if(p == 0)
 		panic("sleep");
@@ -424,51 +980,86 @@ sleep(void *chan, struct spinlock *lk)
 	if(lk == 0)
 		panic("sleep without lk");
 
-	// Must acquire ptable.lock in order to
+	// Must acquire p->lock in order to
 	// change p->state and then call sched.
-	// Once we hold ptable.lock, we can be
-	// guaranteed that we won't miss any wakeup
-	// (wakeup runs with ptable.lock locked),
+	// Once we are on chan's wait queue and hold
+	// p->lock, we can be guaranteed that we won't
+	// miss any wakeup (wakeup locks both),
 	// so it's okay to release lk.
-	if(lk != &ptable.lock){  //DOC: sleeplock0
-		acquire(&ptable.lock);  //DOC: sleeplock1
-		release(lk);
-	}
-	// Go to sleep.
+	wq = &waitq[WQHASH(chan)];
+	acquire(&wq->lock);
+	acquire(&p->lock);  //DOC: sleeplock1
+
+	// Go to sleep, at the tail of the queue.
 	p->chan = chan;
 	p->state = SLEEPING;
+	p->wqnext = 0;
+	for(pp = &wq->head; *pp; pp = &(*pp)->wqnext)
+		;
+	*pp = p;
+	release(&wq->lock);
+	release(lk);
 
 	sched();
 
-	// Tidy up.
-	p->chan = 0;
+	release(&p->lock);
 
-	// Reacquire original lock.
-	if(lk != &ptable.lock){  //DOC: sleeplock2
-		release(&ptable.lock);
-		acquire(lk);
+	// Tidy up.  wakeup takes us off the queue and clears
+	// p->chan; if kill woke us instead, do it here.
+	if(p->chan){
+		acquire(&wq->lock);
+		for(pp = &wq->head; *pp; pp = &(*pp)->wqnext){
+			if(*pp == p){
+				*pp = p->wqnext;
+				break;
+			}
+		}
+		p->chan = 0;
+		release(&wq->lock);
 	}
-}
 
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
-{
-	struct proc *p;
-
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-		if(p->state == SLEEPING && p->chan == chan)
-			p->state = RUNNABLE;
+	// Reacquire original lock.
+	acquire(lk);
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-	acquire(&ptable.lock);
-	wakeup1(chan);
-	release(&ptable.lock);
+	wakeupn(chan, 0x7fffffff);
+}
+
+// Wake up at most n processes sleeping on chan, longest
+// sleeping first, and return how many were woken.
+// Each goes back on the queue of the CPU it last
+// ran on, where its cache state is likely to be.
+int
+wakeupn(void *chan, int n)
+{
+	struct proc *p, **pp;
+	struct waitq *wq;
+	int woken;
+
+	woken = 0;
+	wq = &waitq[WQHASH(chan)];
+	acquire(&wq->lock);
+	for(pp = &wq->head; (p = *pp) != 0 && woken < n; ){
+		if(p->chan != chan){
+			pp = &p->wqnext;
+			continue;
+		}
+		*pp = p->wqnext;
+		p->chan = 0;
+		acquire(&p->lock);
+		if(p->state == SLEEPING){
+			p->state = RUNNABLE;
+			runqput(p);
+			woken++;
+		}
+		release(&p->lock);
+	}
+	release(&wq->lock);
+	return woken;
 }
 
 // Kill the process with the given pid.
@@ -479,19 +1070,21 @@ kill(int pid)
 {
 	struct proc *p;
 
-	acquire(&ptable.lock);
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		if(p->pid == pid){
-			p->killed = 1;
-			// Wake process from sleep if necessary.
-			if(p->state == SLEEPING)
-				p->state = RUNNABLE;
-			release(&ptable.lock);
-			return 0;
-		}
+	acquireread(&ptable.pidlock);
+	if((p = findproc(pid)) == 0){
+		releaseread(&ptable.pidlock);
+		return -1;
 	}
-	release(&ptable.lock);
-	return -1;
+	acquire(&p->lock);
+	p->killed = 1;
+	// Wake process from sleep if necessary.
+	if(p->state == SLEEPING){
+		p->state = RUNNABLE;
+		runqput(p);
+	}
+	release(&p->lock);
+	releaseread(&ptable.pidlock);
+	return 0;
 }
 
 // Print a process listing to console.  For debugging.
@@ -513,7 +1106,7 @@ procdump(void)
 	char *state;
 	uint pc[10];
 
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+	for(p = ptable.all; p; p = p->anext){
 		if(p->state == UNUSED)
 			continue;
 		if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -8,6 +8,10 @@ struct cpu {
 	int ncli;                    // Depth of pushcli nesting.
 	int intena;                  // Were interrupts enabled before pushcli?
 	struct proc *proc;           // The process running on this cpu or null
+	volatile int idle;           // Halted in scheduler, waiting for work
+	uint nexttick;               // TSC at this CPU's next clock tick
+	uint slicestart;             // TSC when proc was last charged
+	uint sliceend;               // TSC when proc's time slice ends
 };
 
 extern struct cpu cpus[NCPU];
@@ -35,19 +39,32 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
+	struct spinlock lock;        // Protects state, killed
 	uint sz;                     // Size of process memory (bytes)
 	pde_t* pgdir;                // Page table
 	char *kstack;                // Bottom of kernel stack for this process
 	enum procstate state;        // Process state
 	int pid;                     // Process ID
 	struct proc *parent;         // Parent process
+	int thread;                  // Made by clone, shares parent's pgdir
+	uint ustack;                 // User stack given to clone
+	struct proc *children;       // First child
+	struct proc *sibling;        // Next child of parent
+	struct proc *pidnext;        // Next in pid hash chain or free list
+	struct proc *anext;          // Next of all proc structures
 	struct trapframe *tf;        // Trap frame for current syscall
 	struct context *context;     // swtch() here to run process
 	void *chan;                  // If non-zero, sleeping on chan
+	struct proc *wqnext;         // Next on chan's wait queue
 	int killed;                  // If non-zero, have been killed
 	struct file *ofile[NOFILE];  // Open files
 	struct inode *cwd;           // Current directory
 	char name[16];               // Process name (debugging)
+	int priority;                // Current level, 0 runs first
+	int basepri;                 // Level set by setpriority()
+	uint used;                   // Microseconds run at this level
+	int cpu;                     // CPU this process last ran on
+	struct proc *rqnext;         // Next on that CPU's run queue
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,92 @@
+// Reader-writer spin locks.
+// Like spin locks, they disable interrupts while held.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "proc.h"
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+	lk->name = name;
+	lk->cnt = 0;
+	lk->cpu = 0;
+}
+
+// Acquire the lock for reading, alongside other readers.
+void
+acquireread(struct rwlock *lk)
+{
+	uint c;
+
+	pushcli();
+	for(;;){
+		c = *(volatile uint*)&lk->cnt;
+		if((c & (RW_WRITER|RW_WAIT)) == 0 && cmpxchg(&lk->cnt, c, c+1) == c)
+			break;
+		pause();
+	}
+	__sync_synchronize();
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+	if((lk->cnt & ~(RW_WRITER|RW_WAIT)) == 0 || (lk->cnt & RW_WRITER))
+		panic("releaseread");
+	__sync_synchronize();
+	__sync_fetch_and_sub(&lk->cnt, 1);
+	popcli();
+}
+
+// Acquire the lock for writing, alone.
+void
+acquirewrite(struct rwlock *lk)
+{
+	uint c;
+
+	pushcli();
+	if(holdingwrite(lk))
+		panic("acquirewrite");
+	for(;;){
+		c = *(volatile uint*)&lk->cnt;
+		if((c & ~RW_WAIT) == 0){
+			if(cmpxchg(&lk->cnt, c, RW_WRITER) == c)
+				break;
+		} else if((c & RW_WAIT) == 0)
+			cmpxchg(&lk->cnt, c, c | RW_WAIT);
+		pause();
+	}
+	__sync_synchronize();
+	lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+	if(!holdingwrite(lk))
+		panic("releasewrite");
+	lk->cpu = 0;
+	__sync_synchronize();
+	// Another writer may set RW_WAIT meanwhile; keep it.
+	__sync_fetch_and_and(&lk->cnt, ~RW_WRITER);
+	popcli();
+}
+
+// Check whether this cpu is holding the lock for writing.
+int
+holdingwrite(struct rwlock *lk)
+{
+	int r;
+
+	pushcli();
+	r = (lk->cnt & RW_WRITER) && lk->cpu == mycpu();
+	popcli();
+	return r;
+}
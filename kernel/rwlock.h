@@ -0,0 +1,14 @@
+// Reader-writer spin lock, for data that is read far more
+// often than it is written.  Any number of readers may hold
+// it at once; a writer holds it alone.  A waiting writer
+// keeps new readers out so that it is not starved.
+struct rwlock {
+	uint cnt;          // Readers holding it, plus the bits below
+
+	// For debugging:
+	char *name;        // Name of lock.
+	struct cpu *cpu;   // The cpu holding it for writing.
+};
+
+#define RW_WRITER  0x80000000  // held by a writer
+#define RW_WAIT    0x40000000  // a writer is waiting
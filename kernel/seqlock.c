@@ -0,0 +1,58 @@
+// Sequence locks.
+//
+// Reader:
+//	do {
+//		s = readseqbegin(&sl);
+//		copy the data;
+//	} while(readseqretry(&sl, s));
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "seqlock.h"
+
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+	initlock(&sl->lk, name);
+	sl->seq = 0;
+}
+
+void
+acquireseq(struct seqlock *sl)
+{
+	acquire(&sl->lk);
+	sl->seq++;
+	__sync_synchronize();
+}
+
+void
+releaseseq(struct seqlock *sl)
+{
+	__sync_synchronize();
+	sl->seq++;
+	release(&sl->lk);
+}
+
+// Return the sequence number to check after reading.
+uint
+readseqbegin(struct seqlock *sl)
+{
+	uint s;
+
+	while((s = *(volatile uint*)&sl->seq) & 1)
+		pause();
+	__sync_synchronize();
+	return s;
+}
+
+// Whether a writer ran since readseqbegin returned s,
+// so what was read must be read again.
+int
+readseqretry(struct seqlock *sl, uint s)
+{
+	__sync_synchronize();
+	return *(volatile uint*)&sl->seq != s;
+}
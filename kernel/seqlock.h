@@ -0,0 +1,8 @@
+// Sequence lock, for small data read far more often than
+// it is written.  Writers serialize on lk and make seq odd
+// while they work; readers take no lock at all, but retry
+// if seq was odd or moved while they read.
+struct seqlock {
+	uint seq;
+	struct spinlock lk;  // serializes writers
+};
@@ -6,27 +6,62 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
+// Longest a waiter spins for a running holder (microseconds).
+#define SLEEPSPIN 50
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
 	initlock(&lk->lk, "sleep lock");
 	lk->name = name;
 	lk->locked = 0;
+	lk->owner = 0;
 	lk->pid = 0;
 }
 
+// Buffer and inode locks are mostly held briefly, so if
+// the holder is running on another CPU it is likely to
+// let go sooner than two trips through the scheduler.
+// Spin for it, with lk->lk released, for at most
+// SLEEPSPIN microseconds or until it stops running.
+// Called and returns with lk->lk held; returns whether
+// the lock came free.
+static int
+spinsleep(struct sleeplock *lk)
+{
+	struct proc *owner;
+	uint t0, limit;
+
+	owner = lk->owner;
+	if(ncpu == 1 || owner == 0 || owner->state != RUNNING)
+		return 0;
+	release(&lk->lk);
+	limit = SLEEPSPIN * tscmhz;
+	t0 = rdtsc();
+	while(*(volatile uint*)&lk->locked &&
+	      *(struct proc* volatile*)&lk->owner == owner &&
+	      *(volatile enum procstate*)&owner->state == RUNNING &&
+	      rdtsc() - t0 < limit)
+		pause();
+	acquire(&lk->lk);
+	return !lk->locked;
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
 	acquire(&lk->lk);
 	while (lk->locked) {
+		if(spinsleep(lk))
+			continue;
 		sleep(lk, &lk->lk);
 	}
 	lk->locked = 1;
+	lk->owner = myproc();
 	lk->pid = myproc()->pid;
 	release(&lk->lk);
 }
@@ -36,6 +71,7 @@ releasesleep(struct sleeplock *lk)
 {
 	acquire(&lk->lk);
 	lk->locked = 0;
+	lk->owner = 0;
 	lk->pid = 0;
 	wakeup(lk);
 	release(&lk->lk);
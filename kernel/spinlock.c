@@ -6,15 +6,62 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+
+// Contention counters, kept per lock name rather than per
+// lock so that locks in freed memory need no cleanup, and
+// per CPU so that counting causes no cache-line traffic.
+// A name gets a class the first time a lock is given it;
+// the last class collects names that do not fit.
+#define NLOCKCLASS 64
+
+struct lockcount {
+	uint nacquire;
+	uint ncontend;
+	uint64 spin;
+};
+
+static struct {
+	uint locked;     // guards adding a class
+	int n;
+	char *name[NLOCKCLASS];
+} lockclass;
+static struct lockcount lockcount[NCPU][NLOCKCLASS];
+
+static int
+lockclassof(char *name)
+{
+	int i;
+
+	// Not acquire, which needs a class, nor pushcli, which
+	// cannot run before mpinit.
+	while(xchg(&lockclass.locked, 1) != 0)
+		pause();
+	for(i = 0; i < lockclass.n; i++)
+		if(strncmp(lockclass.name[i], name, LOCKNAME) == 0)
+			break;
+	if(i == NLOCKCLASS)
+		i = NLOCKCLASS-1;
+	else if(i == lockclass.n){
+		if(i == NLOCKCLASS-1)
+			name = "(other)";
+		lockclass.name[i] = name;
+		lockclass.n++;
+	}
+	xchg(&lockclass.locked, 0);
+	return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
 	lk->name = name;
-	lk->locked = 0;
+	lk->next = 0;
+	lk->owner = 0;
 	lk->cpu = 0;
+	lk->class = lockclassof(name);
 }
 
 // Acquire the lock.
@@ -24,13 +71,35 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+	struct lockcount *lc;
+	struct cpu *c;
+	uint ticket, t0;
+
 	pushcli(); // disable interrupts to avoid deadlock.
-	if(holding(lk))
+	if(holding(lk)){
+#ifdef LOCKDEBUG
+		int i;
+
+		cprintf("%s: held since", lk->name);
+		for(i = 0; i < 10 && lk->pcs[i]; i++)
+			cprintf(" %p", lk->pcs[i]);
+		cprintf("\n");
+#endif
 		panic("acquire");
+	}
 
-	// The xchg is atomic.
-	while(xchg(&lk->locked, 1) != 0)
-		;
+	// The fetch-and-add is atomic.
+	ticket = __sync_fetch_and_add(&lk->next, 1);
+	c = mycpu();
+	lc = &lockcount[c - cpus][lk->class];
+	if(*(volatile uint*)&lk->owner != ticket){
+		t0 = rdtsc();
+		while(*(volatile uint*)&lk->owner != ticket)
+			pause();
+		lc->spin += rdtsc() - t0;
+		lc->ncontend++;
+	}
+	lc->nacquire++;
 
 	// Tell the C compiler and the processor to not move loads or stores
 	// past this point, to ensure that the critical section's memory
@@ -38,8 +107,12 @@ acquire(struct spinlock *lk)
 	__sync_synchronize();
 
 	// Record info about lock acquisition for debugging.
-	lk->cpu = mycpu();
+	// Walking the stack is too slow for every acquire, so
+	// only LOCKDEBUG kernels do it.
+	lk->cpu = c;
+#ifdef LOCKDEBUG
 	getcallerpcs(&lk, lk->pcs);
+#endif
 }
 
 // Release the lock.
@@ -49,7 +122,9 @@ release(struct spinlock *lk)
 	if(!holding(lk))
 		panic("release");
 
+#ifdef LOCKDEBUG
 	lk->pcs[0] = 0;
+#endif
 	lk->cpu = 0;
 
 	// Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +134,10 @@ release(struct spinlock *lk)
 	// stores; __sync_synchronize() tells them both not to.
 	__sync_synchronize();
 
-	// Release the lock, equivalent to lk->locked = 0.
-	// This code can't use a C assignment, since it might
-	// not be atomic. A real OS would use C atomics here.
-	asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+	// Serve the next ticket, equivalent to lk->owner++.
+	// Only the holder writes owner, so the increment need
+	// not be locked, but it must be a single store.
+	asm volatile("incl %0" : "+m" (lk->owner) : );
 
 	popcli();
 }
@@ -91,7 +166,7 @@ holding(struct spinlock *lock)
 {
 	int r;
 	pushcli();
-	r = lock->locked && lock->cpu == mycpu();
+	r = lock->owner != lock->next && lock->cpu == mycpu();
 	popcli();
 	return r;
 }
@@ -124,3 +199,50 @@ popcli(void)
 		sti();
 }
 
+// Copy the counters of lock class i into *st.
+// Returns -1 if there is no class i.
+int
+lockstat(int i, struct lockstat *st)
+{
+	int c;
+
+	if(i < 0 || i >= lockclass.n)
+		return -1;
+	safestrcpy(st->name, lockclass.name[i], sizeof(st->name));
+	st->nacquire = st->ncontend = 0;
+	st->spin = 0;
+	for(c = 0; c < ncpu; c++){
+		st->nacquire += lockcount[c][i].nacquire;
+		st->ncontend += lockcount[c][i].ncontend;
+		st->spin += lockcount[c][i].spin;
+	}
+	return 0;
+}
+
+// Zero all the counters.
+void
+lockstatreset(void)
+{
+	memset(lockcount, 0, sizeof(lockcount));
+}
+
+// Time n acquire/release pairs of an uncontended lock and
+// return the average in TSC cycles, to show what the lock
+// fast path costs in this build.
+int
+lockbench(int n)
+{
+	struct spinlock lk;
+	uint t0;
+	int i;
+
+	if(n <= 0)
+		return -1;
+	initlock(&lk, "lockbench");
+	t0 = rdtsc();
+	for(i = 0; i < n; i++){
+		acquire(&lk);
+		release(&lk);
+	}
+	return (rdtsc() - t0) / n;
+}
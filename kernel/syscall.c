@@ -3,9 +3,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "sysring.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -103,6 +105,14 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_setpriority(void);
+extern int sys_sysctl(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex(void);
+extern int sys_fcntl(void);
+extern int sys_lockstat(void);
+extern int sys_ringenter(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,6 +136,14 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_setpriority] sys_setpriority,
+[SYS_sysctl]  sys_sysctl,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_fcntl]   sys_fcntl,
+[SYS_lockstat] sys_lockstat,
+[SYS_ringenter] sys_ringenter,
 };
 
 void
@@ -143,3 +161,57 @@ syscall(void)
 		curproc->tf->eax = -1;
 	}
 }
+
+// Run up to n system calls queued in the user's ring r
+// (see sysring.h), in one trip into the kernel.  Each
+// handler finds its arguments in the queue entry, which
+// is posed as the user stack.  Calls that do not return
+// to the caller as usual, or that could unmap the ring,
+// are refused.  Returns how many
+// calls ran, stopping early if the completion queue fills
+// or the process is killed.
+int
+sys_ringenter(void)
+{
+	struct sysring *r;
+	struct sqe *e;
+	struct cqe *c;
+	struct proc *curproc = myproc();
+	uint esp, tail;
+	int n, done, num, ret;
+
+	if(argptr(0, (void*)&r, sizeof(*r)) < 0 || argint(1, &n) < 0)
+		return -1;
+	esp = curproc->tf->esp;
+	tail = r->sqtail;
+	for(done = 0; done < n && r->sqhead != tail; done++){
+		if(r->cqtail - r->cqhead >= NRING || curproc->killed)
+			break;
+		e = &r->sq[r->sqhead % NRING];
+		num = e->num;
+		switch(num){
+		case SYS_fork:
+		case SYS_exit:
+		case SYS_exec:
+		case SYS_clone:
+		case SYS_sbrk:
+		case SYS_ringenter:
+			ret = -1;
+			break;
+		default:
+			if(num <= 0 || num >= NELEM(syscalls) || !syscalls[num]){
+				ret = -1;
+				break;
+			}
+			curproc->tf->esp = (uint)e->arg - 4;
+			ret = syscalls[num]();
+			curproc->tf->esp = esp;
+		}
+		c = &r->cq[r->cqtail % NRING];
+		c->ret = ret;
+		c->data = e->data;
+		r->cqtail++;
+		r->sqhead++;
+	}
+	return done;
+}
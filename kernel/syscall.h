@@ -20,3 +20,11 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_setpriority 22
+#define SYS_sysctl 23
+#define SYS_clone  24
+#define SYS_join   25
+#define SYS_futex  26
+#define SYS_fcntl  27
+#define SYS_lockstat 28
+#define SYS_ringenter 29
@@ -0,0 +1,3 @@
+// Names for sysctl()
+#define CTL_QUANTUM  1   // time slice at top priority (microseconds)
+#define CTL_BOOST    2   // clock ticks between priority boosts
@@ -9,9 +9,9 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
@@ -184,7 +184,6 @@ int
 sys_unlink(void)
 {
 	struct inode *ip, *dp;
-	struct dirent de;
 	char name[DIRSIZ], *path;
 	uint off;
 
@@ -214,9 +213,7 @@ sys_unlink(void)
 		goto bad;
 	}
 
-	memset(&de, 0, sizeof(de));
-	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-		panic("unlink: writei");
+	dirunlink(dp, name, off);
 	if(ip->type == T_DIR){
 		dp->nlink--;
 		iupdate(dp);
@@ -256,8 +253,10 @@ create(char *path, short type, short major, short minor)
 		return 0;
 	}
 
-	if((ip = ialloc(dp->dev, type)) == 0)
-		panic("create: ialloc");
+	if((ip = ialloc(dp->dev, type, dp->inum)) == 0){
+		iunlockput(dp);
+		return 0;
+	}
 
 	ilock(ip);
 	ip->major = major;
@@ -266,15 +265,25 @@ create(char *path, short type, short major, short minor)
 	iupdate(ip);
 
 	if(type == T_DIR){  // Create . and .. entries.
-		dp->nlink++;  // for ".."
-		iupdate(dp);
 		// No ip->nlink++ for ".": avoid cyclic ref count.
 		if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
 			panic("create dots");
 	}
 
-	if(dirlink(dp, name, ip->inum) < 0)
-		panic("create: dirlink");
+	// dirlookup above misses an existing name when the inode
+	// cache is full, so dirlink can still find it present.
+	if(dirlink(dp, name, ip->inum) < 0){
+		ip->nlink = 0;
+		iupdate(ip);
+		iunlockput(ip);
+		iunlockput(dp);
+		return 0;
+	}
+
+	if(type == T_DIR){
+		dp->nlink++;  // for ".."
+		iupdate(dp);
+	}
 
 	iunlockput(dp);
 
@@ -441,3 +450,24 @@ sys_pipe(void)
 	fd[1] = fd1;
 	return 0;
 }
+
+int
+sys_fcntl(void)
+{
+	struct file *f;
+	int cmd, arg;
+
+	if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+		return -1;
+	if(f->type != FD_PIPE)
+		return -1;
+	switch(cmd){
+	case F_GETPIPE_SZ:
+		return pipesize(f->pipe, 0);
+	case F_SETPIPE_SZ:
+		if(arg <= 0)
+			return -1;
+		return pipesize(f->pipe, arg);
+	}
+	return -1;
+}
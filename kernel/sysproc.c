@@ -5,7 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "seqlock.h"
 #include "proc.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -26,6 +29,30 @@ sys_wait(void)
 	return wait();
 }
 
+int
+sys_clone(void)
+{
+	int fn, arg, stack;
+
+	if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+		return -1;
+	return clone((void(*)(void*))fn, (void*)arg, (void*)stack);
+}
+
+int
+sys_join(void)
+{
+	int addr;
+	uint *stack;
+
+	stack = 0;
+	if(argint(0, &addr) < 0)
+		return -1;
+	if(addr && argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+		return -1;
+	return join(stack);
+}
+
 int
 sys_kill(void)
 {
@@ -50,8 +77,7 @@ sys_sbrk(void)
 
 	if(argint(0, &n) < 0)
 		return -1;
-	addr = myproc()->sz;
-	if(growproc(n) < 0)
+	if((addr = growproc(n)) < 0)
 		return -1;
 	return addr;
 }
@@ -60,21 +86,10 @@ int
 sys_sleep(void)
 {
 	int n;
-	uint ticks0;
 
 	if(argint(0, &n) < 0)
 		return -1;
-	acquire(&tickslock);
-	ticks0 = ticks;
-	while(ticks - ticks0 < n){
-		if(myproc()->killed){
-			release(&tickslock);
-			return -1;
-		}
-		sleep(&ticks, &tickslock);
-	}
-	release(&tickslock);
-	return 0;
+	return timersleep(n);
 }
 
 // return how many clock tick interrupts have occurred
@@ -82,10 +97,67 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-	uint xticks;
+	uint xticks, s;
 
-	acquire(&tickslock);
-	xticks = ticks;
-	release(&tickslock);
+	do {
+		s = readseqbegin(&tickslock);
+		xticks = ticks;
+	} while(readseqretry(&tickslock, s));
 	return xticks;
 }
+
+// set the scheduling priority of a process;
+// returns its previous priority.
+int
+sys_setpriority(void)
+{
+	int pid, pri;
+
+	if(argint(0, &pid) < 0 || argint(1, &pri) < 0)
+		return -1;
+	return setpriority(pid, pri);
+}
+
+// read and optionally set a kernel parameter;
+// returns its previous value.
+int
+sys_sysctl(void)
+{
+	int name, val;
+
+	if(argint(0, &name) < 0 || argint(1, &val) < 0)
+		return -1;
+	return sysctl(name, val);
+}
+
+// wait on or wake a user memory word (see futex.c)
+int
+sys_futex(void)
+{
+	int addr, op, val;
+
+	if(argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+		return -1;
+	return futex(addr, op, val);
+}
+
+// lockstat(i, st) fills *st with the counters of lock
+// class i; see lockstat.h for the special values of i.
+int
+sys_lockstat(void)
+{
+	int i;
+	struct lockstat *st;
+
+	if(argint(0, &i) < 0)
+		return -1;
+	if(i == LOCKSTAT_RESET){
+		lockstatreset();
+		return 0;
+	}
+	if(i == LOCKSTAT_BENCH)
+		return lockbench(10000);
+	if(argptr(1, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+	return lockstat(i, st);
+}
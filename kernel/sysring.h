@@ -0,0 +1,26 @@
+// Batched system calls, see sys_ringenter in syscall.c.
+// The user fills sq[] and advances sqtail; ringenter runs
+// the calls in order, advancing sqhead, and posts each
+// result to cq[], advancing cqtail; the user takes the
+// results and advances cqhead.  The indices only grow;
+// an entry lives at index % NRING.  The ring is plain
+// user memory, owned by one thread at a time.
+#define NRING 32
+
+struct sqe {
+	int num;     // system call number
+	int arg[3];  // its arguments, as they would be on the stack
+	uint data;   // handed back with the result
+};
+
+struct cqe {
+	int ret;     // what the system call returned
+	uint data;
+};
+
+struct sysring {
+	uint sqhead, sqtail;
+	uint cqhead, cqtail;
+	struct sqe sq[NRING];
+	struct cqe cq[NRING];
+};
@@ -0,0 +1,176 @@
+// Hierarchical timer wheel.
+//
+// A timer calls its function once ticks reaches its deadline.
+// Timers due within WHEELSIZE ticks hang off the first wheel,
+// one slot per tick.  Later ones go on coarser wheels, each
+// slot of level l covering WHEELSIZE^l ticks, and cascade one
+// level down each time the wheel below wraps around.  So each
+// clock tick looks at one slot, and a sleeping process is only
+// woken when its own deadline passes.
+//
+// Timer functions run in the clock interrupt with tw.lock
+// held; they must not add or delete timers.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+
+#define WHEELBITS 6
+#define WHEELSIZE (1<<WHEELBITS)
+#define WHEELMASK (WHEELSIZE-1)
+#define NLEVEL 4
+#define MAXDELTA ((1<<(WHEELBITS*NLEVEL)) - 1)
+
+struct {
+	struct spinlock lock;
+	uint now;                  // Last tick processed
+	struct timer *wheel[NLEVEL][WHEELSIZE];
+} tw;
+
+void
+timerinit(void)
+{
+	initlock(&tw.lock, "timer");
+}
+
+// Hang t off the slot for its deadline.  A timer due
+// now goes in the current slot, which timertick is about
+// to run.  Caller must hold tw.lock.
+static void
+tinsert(struct timer *t)
+{
+	uint delta, e;
+	int l;
+
+	delta = t->expires - tw.now;
+	if((int)delta < 0)
+		delta = 0;
+	if(delta > MAXDELTA)
+		delta = MAXDELTA;
+	e = tw.now + delta;
+	for(l = 0; l < NLEVEL-1; l++)
+		if(delta < (1 << (WHEELBITS*(l+1))))
+			break;
+	t->slot = &tw.wheel[l][(e >> (WHEELBITS*l)) & WHEELMASK];
+	t->next = *t->slot;
+	*t->slot = t;
+}
+
+// Call fn(arg) once n ticks have passed.
+void
+timeradd(struct timer *t, int n, void (*fn)(void*), void *arg)
+{
+	acquire(&tw.lock);
+	if(t->slot)
+		panic("timeradd");
+	t->expires = tw.now + (n > 0 ? n : 1);
+	t->fn = fn;
+	t->arg = arg;
+	tinsert(t);
+	release(&tw.lock);
+}
+
+// Unlink t from its slot.  Caller must hold tw.lock.
+static void
+tremove(struct timer *t)
+{
+	struct timer **pp;
+
+	for(pp = t->slot; *pp; pp = &(*pp)->next){
+		if(*pp == t){
+			*pp = t->next;
+			break;
+		}
+	}
+	t->slot = 0;
+}
+
+// Cancel t.  Return 1 if it had not yet fired.
+int
+timerdel(struct timer *t)
+{
+	int pending;
+
+	acquire(&tw.lock);
+	pending = t->slot != 0;
+	if(pending)
+		tremove(t);
+	release(&tw.lock);
+	return pending;
+}
+
+// Called by the clock interrupt after ticks advances.
+void
+timertick(void)
+{
+	struct timer *t, *next;
+	int l;
+
+	acquire(&tw.lock);
+	while(tw.now != ticks){
+		tw.now++;
+
+		// Cascade coarser slots whose time has come.
+		for(l = 1; l < NLEVEL; l++){
+			if((tw.now >> (WHEELBITS*(l-1))) & WHEELMASK)
+				break;
+			t = tw.wheel[l][(tw.now >> (WHEELBITS*l)) & WHEELMASK];
+			tw.wheel[l][(tw.now >> (WHEELBITS*l)) & WHEELMASK] = 0;
+			for(; t; t = next){
+				next = t->next;
+				tinsert(t);
+			}
+		}
+
+		t = tw.wheel[0][tw.now & WHEELMASK];
+		tw.wheel[0][tw.now & WHEELMASK] = 0;
+		for(; t; t = next){
+			next = t->next;
+			if((int)(t->expires - tw.now) > 0){
+				// Deadline was clamped to MAXDELTA.
+				tinsert(t);
+				continue;
+			}
+			t->slot = 0;
+			t->fn(t->arg);
+		}
+	}
+	release(&tw.lock);
+}
+
+static void
+timerwakeup(void *chan)
+{
+	wakeup(chan);
+}
+
+// Sleep for n clock ticks.
+// Return -1 if the process was killed first.
+int
+timersleep(int n)
+{
+	struct timer t;
+
+	if(n <= 0)
+		return 0;
+	t.slot = 0;
+	acquire(&tw.lock);
+	t.expires = tw.now + n;
+	t.fn = timerwakeup;
+	t.arg = &t;
+	tinsert(&t);
+	while(t.slot){
+		if(myproc()->killed){
+			tremove(&t);
+			release(&tw.lock);
+			return -1;
+		}
+		sleep(&t, &tw.lock);
+	}
+	release(&tw.lock);
+	return 0;
+}
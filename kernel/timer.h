@@ -0,0 +1,8 @@
+// Kernel timer, see timer.c
+struct timer {
+	uint expires;              // Value of ticks at which to fire
+	void (*fn)(void*);         // Called from the clock interrupt
+	void *arg;                 // Argument to fn
+	struct timer **slot;       // Wheel slot holding us, 0 if not pending
+	struct timer *next;        // Next timer in that slot
+};
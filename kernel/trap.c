@@ -3,15 +3,17 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "seqlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
+#include "vdso.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
+struct seqlock tickslock;  // lets uptime read ticks without a lock
 uint ticks;
 
 void
@@ -23,7 +25,7 @@ tvinit(void)
 		SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
 	SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
 
-	initlock(&tickslock, "time");
+	initseqlock(&tickslock, "time");
 }
 
 void
@@ -32,9 +34,29 @@ idtinit(void)
 	lidt(idt, sizeof(idt));
 }
 
+// A CPU without sysenter faults on the usys.S stubs with
+// an invalid opcode.  Turn that into the system call it
+// meant, set to return where sysexit would have.
+static int
+sysenteremul(struct trapframe *tf)
+{
+	if((tf->cs&3) != DPL_USER || havesysenter)
+		return 0;
+	if(tf->eip >= myproc()->sz || tf->eip+2 > myproc()->sz ||
+	   *(ushort*)tf->eip != 0x340f)  // sysenter
+		return 0;
+	tf->eip = tf->edx;
+	tf->esp = tf->ecx;
+	return 1;
+}
+
 void
 trap(struct trapframe *tf)
 {
+	int n;
+
+	if(tf->trapno == T_ILLOP && sysenteremul(tf))
+		tf->trapno = T_SYSCALL;
 	if(tf->trapno == T_SYSCALL){
 		if(myproc()->killed)
 			exit();
@@ -47,12 +69,26 @@ trap(struct trapframe *tf)
 
 	switch(tf->trapno){
 	case T_IRQ0 + IRQ_TIMER:
+		// The timer also fires at the end of time slices,
+		// so there may be no clock tick due yet.
+		n = lapicticks();
 		if(cpuid() == 0){
-			acquire(&tickslock);
-			ticks++;
-			wakeup(&ticks);
-			release(&tickslock);
+			for(; n > 0; n--){
+				acquireseq(&tickslock);
+				ticks++;
+				vdso->ticks = ticks;
+				releaseseq(&tickslock);
+				timertick();
+				if(ticks % boostticks == 0)
+					boost();
+			}
 		}
+		lapicarm();
+		lapiceoi();
+		break;
+	case T_IRQ0 + IRQ_WAKEUP:
+		// Sent by runqput to an idle CPU; just return
+		// to the scheduler loop, which looks for work.
 		lapiceoi();
 		break;
 	case T_IRQ0 + IRQ_IDE:
@@ -77,6 +113,13 @@ trap(struct trapframe *tf)
 		lapiceoi();
 		break;
 
+	case T_PGFLT:
+		// A write to a copy-on-write page, from user space or
+		// from the kernel copying into a user buffer.
+		if(myproc() && (tf->err & FEC_WR) &&
+		   cowfault(myproc()->pgdir, rcr2()) == 0)
+			break;
+		// fall through
 	default:
 		if(myproc() == 0 || (tf->cs&3) == 0){
 			// In kernel, it must be our mistake.
@@ -98,10 +141,11 @@ trap(struct trapframe *tf)
 	if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
 		exit();
 
-	// Force process to give up CPU on clock tick.
+	// Give up the CPU on a timer interrupt if the process's
+	// time slice is used or a higher level is waiting.
 	// If interrupts were on while locks held, would need to check nlock.
 	if(myproc() && myproc()->state == RUNNING &&
-			tf->trapno == T_IRQ0+IRQ_TIMER)
+			tf->trapno == T_IRQ0+IRQ_TIMER && schedtick())
 		yield();
 
 	// Check if the process has been killed since we yielded
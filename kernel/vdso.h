@@ -0,0 +1,11 @@
+// Kernel data that user code can read without a system
+// call, in pages mapped read-only into every address
+// space at VDSO and VDSOPROC (see memlayout.h).
+struct vdso {
+	uint ticks;   // clock ticks since boot, as uptime returns
+};
+
+// One per address space.
+struct vdsoproc {
+	int pid;      // the process's pid; 0 if threads share the space
+};
@@ -4,11 +4,16 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
+#include "vdso.h"
 
 extern char data[];  // defined by kernel.ld
+extern char sysenterentry[];  // trapasm.S
 pde_t *kpgdir;  // for use in scheduler()
+int havesysenter;  // CPUs support sysenter/sysexit
+struct vdso *vdso;  // the page at VDSO
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -27,6 +32,17 @@ seginit(void)
 	c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
 	c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
 	lgdt(c->gdt, sizeof(c->gdt));
+
+	// Fast system call entry.  sysenter loads %cs and %ss
+	// from MSR_SYSENTER_CS and the two selectors after it,
+	// and sysexit the two after those, so the GDT order of
+	// KCODE, KDATA, UCODE, UDATA matters.  switchuvm points
+	// MSR_SYSENTER_ESP at each process's kernel stack.
+	havesysenter = (cpuidedx(1) & CPUID_SEP) != 0;
+	if(havesysenter){
+		wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+		wrmsr(MSR_SYSENTER_EIP, (uint)sysenterentry);
+	}
 }
 
 // Return the address of the PTE in page table pgdir
@@ -94,6 +110,7 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //                for the kernel's instructions and r/o data
 //   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
 //                                  rw data + free physical memory
+//   VDSO, VDSOPROC: read-only to the user, see vdso.h
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
@@ -114,17 +131,18 @@ static struct kmap {
 	{ (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table, and the vdso pages.
 pde_t*
 setupkvm(void)
 {
 	pde_t *pgdir;
 	struct kmap *k;
+	char *mem;
 
 	if((pgdir = (pde_t*)kalloc()) == 0)
 		return 0;
 	memset(pgdir, 0, PGSIZE);
-	if (P2V(PHYSTOP) > (void*)DEVSPACE)
+	if (P2V(PHYSTOP) > (void*)VDSO)
 		panic("PHYSTOP too high");
 	for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
 		if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
@@ -132,14 +150,40 @@ setupkvm(void)
 			freevm(pgdir);
 			return 0;
 		}
+	if((mem = kalloc()) == 0){
+		freevm(pgdir);
+		return 0;
+	}
+	memset(mem, 0, PGSIZE);
+	if(mappages(pgdir, (char*)VDSO, PGSIZE, V2P(vdso), PTE_U) < 0 ||
+	   mappages(pgdir, (char*)VDSOPROC, PGSIZE, V2P(mem), PTE_U) < 0){
+		kfree(mem);
+		freevm(pgdir);
+		return 0;
+	}
 	return pgdir;
 }
 
+// Publish pid in pgdir's VDSOPROC page.  0 sends user
+// code to the kernel instead, for threads sharing pgdir.
+void
+vdsosetpid(pde_t *pgdir, int pid)
+{
+	pte_t *pte;
+
+	if((pte = walkpgdir(pgdir, (char*)VDSOPROC, 0)) == 0 || !(*pte & PTE_P))
+		panic("vdsosetpid");
+	((struct vdsoproc*)P2V(PTE_ADDR(*pte)))->pid = pid;
+}
+
 // Allocate one page table for the machine for the kernel address
 // space for scheduler processes.
 void
 kvmalloc(void)
 {
+	if((vdso = (struct vdso*)kalloc()) == 0)
+		panic("kvmalloc: vdso");
+	memset(vdso, 0, PGSIZE);
 	kpgdir = setupkvm();
 	switchkvm();
 }
@@ -169,6 +213,8 @@ switchuvm(struct proc *p)
 	SEG_CLS(mycpu()->gdt[SEG_TSS]);
 	mycpu()->ts.ss0 = SEG_KDATA << 3;
 	mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+	if(havesysenter)
+		wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
 	// setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
 	// forbids I/O instructions (e.g., inb and outb) from user space
 	mycpu()->ts.iomb = (ushort) 0xFFFF;
@@ -284,10 +330,15 @@ void
 freevm(pde_t *pgdir)
 {
 	uint i;
+	pte_t *pte;
 
 	if(pgdir == 0)
 		panic("freevm: no pgdir");
+	if(kderef((char*)pgdir))
+		return;  // still in use by another thread
 	deallocuvm(pgdir, KERNBASE, 0);
+	if((pte = walkpgdir(pgdir, (char*)VDSOPROC, 0)) != 0 && (*pte & PTE_P))
+		kfree(P2V(PTE_ADDR(*pte)));
 	for(i = 0; i < NPDENTRIES; i++){
 		if(pgdir[i] & PTE_P){
 			char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -329,6 +380,8 @@ copyuvm(pde_t *pgdir, uint sz)
 			panic("copyuvm: page not present");
 		pa = PTE_ADDR(*pte);
 		flags = PTE_FLAGS(*pte);
+		if(flags & PTE_COW)
+			flags = (flags & ~PTE_COW) | PTE_W;  // child's copy is private
 		if((mem = kalloc()) == 0)
 			goto bad;
 		memmove(mem, (char*)P2V(pa), PGSIZE);
@@ -370,6 +423,10 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 	buf = (char*)p;
 	while(len > 0){
 		va0 = (uint)PGROUNDDOWN(va);
+		// Writing through the kernel mapping bypasses the
+		// page protection, so break copy-on-write by hand.
+		if(cowfault(pgdir, va0) < 0)
+			return -1;
 		pa0 = uva2ka(pgdir, (char*)va0);
 		if(pa0 == 0)
 			return -1;
@@ -383,3 +440,105 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 	}
 	return 0;
 }
+
+// Handle a write to user address va in pgdir.  If its page
+// is copy-on-write, give pgdir a private writable copy, or
+// just make it writable if no one else holds it.  Returns
+// -1 if the page is not present or not writable.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+	pte_t *pte;
+	char *v, *mem;
+
+	if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+		return -1;
+	if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+		return -1;
+	if(*pte & PTE_W)
+		return 0;  // already done, or a stale TLB entry
+	if((*pte & PTE_COW) == 0)
+		return -1;
+	v = P2V(PTE_ADDR(*pte));
+	if(kshared(v)){
+		if((mem = kalloc()) == 0)
+			return -1;
+		memmove(mem, v, PGSIZE);
+		*pte = V2P(mem) | PTE_FLAGS(*pte);
+		kfree(v);
+	}
+	*pte = (*pte & ~PTE_COW) | PTE_W;
+	invlpg((void*)va);
+	return 0;
+}
+
+// Give pgdir private writable copies of all its copy-on-write
+// pages below sz, before clone shares it.  cowfault takes no
+// lock and flushes only this CPU's TLB, so threads sharing a
+// page table must never meet a copy-on-write page.
+int
+cowbreak(pde_t *pgdir, uint sz)
+{
+	pte_t *pte;
+	uint a;
+
+	for(a = 0; a < sz; a += PGSIZE){
+		if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0){
+			a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+			continue;
+		}
+		if((*pte & PTE_P) && (*pte & PTE_COW) && cowfault(pgdir, a) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Lend the page at page-aligned user address uva, for a
+// zero-copy pipe write: make it copy-on-write in pgdir and
+// return its kernel address with a reference added for
+// the borrower.  Returns 0 if the page is not writable.
+char*
+vmlend(pde_t *pgdir, char *uva)
+{
+	pte_t *pte;
+	char *v;
+
+	if((uint)uva >= KERNBASE || (pte = walkpgdir(pgdir, uva, 0)) == 0)
+		return 0;
+	if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) ||
+	   (*pte & (PTE_W|PTE_COW)) == 0)
+		return 0;
+	if(*pte & PTE_W){
+		*pte = (*pte & ~PTE_W) | PTE_COW;
+		invlpg(uva);
+	}
+	v = P2V(PTE_ADDR(*pte));
+	kref(v);
+	return v;
+}
+
+// Map the page at kernel address page copy-on-write at
+// page-aligned user address uva, for a zero-copy pipe
+// read.  The caller's reference to page passes to pgdir,
+// and pgdir's reference to the page it replaces passes
+// back to the caller, whose kernel address is returned.
+// Returns 0 and changes nothing unless the old page is
+// writable and held by pgdir alone.
+char*
+vmremap(pde_t *pgdir, char *uva, char *page)
+{
+	pte_t *pte;
+	char *old;
+
+	if((uint)uva >= KERNBASE || (pte = walkpgdir(pgdir, uva, 0)) == 0)
+		return 0;
+	if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) ||
+	   (*pte & (PTE_W|PTE_COW)) == 0)
+		return 0;
+	old = P2V(PTE_ADDR(*pte));
+	if(kshared(old))
+		return 0;
+	*pte = V2P(page) | PTE_P | PTE_U | PTE_COW;
+	invlpg(uva);
+	return old;
+}
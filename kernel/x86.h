@@ -87,6 +87,39 @@ ltr(ushort sel)
 	asm volatile("ltr %0" : : "r" (sel));
 }
 
+// Return %edx of cpuid leaf, the feature flags for leaf 1.
+static inline uint
+cpuidedx(uint leaf)
+{
+	uint a, b, c, d;
+
+	asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (leaf));
+	return d;
+}
+
+#define CPUID_SEP  (1<<11)   // sysenter/sysexit
+
+// Model-specific registers for sysenter.
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
+
+static inline void
+wrmsr(uint msr, uint val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+// Low 32 bits of the time-stamp counter.
+static inline uint
+rdtsc(void)
+{
+	uint lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return lo;
+}
+
 static inline uint
 readeflags(void)
 {
@@ -113,6 +146,15 @@ sti(void)
 	asm volatile("sti");
 }
 
+// Enable interrupts and halt until one arrives.  sti takes
+// effect only after the next instruction, so no interrupt
+// can be taken between the two and missed by hlt.
+static inline void
+stihlt(void)
+{
+	asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -126,6 +168,27 @@ xchg(volatile uint *addr, uint newval)
 	return result;
 }
 
+// Atomically set *addr to newval if it holds old.
+// Return the value *addr held.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+	uint result;
+
+	asm volatile("lock; cmpxchgl %2, %1" :
+		     "=a" (result), "+m" (*addr) :
+		     "r" (newval), "0" (old) :
+		     "cc");
+	return result;
+}
+
+// Hint to the CPU that this is a spin-wait loop.
+static inline void
+pause(void)
+{
+	asm volatile("pause");
+}
+
 static inline uint
 rcr2(void)
 {
@@ -140,6 +203,13 @@ lcr3(uint val)
 	asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// Flush the TLB entry for the page holding va.
+static inline void
+invlpg(void *va)
+{
+	asm volatile("invlpg (%0)" : : "r" (va) : "memory");
+}
+
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
 struct trapframe {
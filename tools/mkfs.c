@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + 1;  // header block + LOGSIZE data blocks
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -44,6 +44,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void hashalloc(uint inum);
+void dappend(uint dirino, struct dirent *de);
 
 // convert to intel byte order
 ushort
@@ -75,71 +77,75 @@ makedirs(void)
 
 	// /
 	rootino = ialloc(T_DIR);
+	hashalloc(rootino);
 	assert(rootino == ROOTINO);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(rootino);
 	strcpy(de.name, ".");
-	iappend(rootino, &de, sizeof(de));
+	dappend(rootino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(rootino);
 	strcpy(de.name, "..");
-	iappend(rootino, &de, sizeof(de));
+	dappend(rootino, &de);
 
 	// /dev
 	devino = ialloc(T_DIR);
+	hashalloc(devino);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(devino);
 	strcpy(de.name, ".");
-	iappend(devino, &de, sizeof(de));
+	dappend(devino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(rootino);
 	strcpy(de.name, "..");
-	iappend(devino, &de, sizeof(de));
+	dappend(devino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(devino);
 	strcpy(de.name, "dev");
-	iappend(rootino, &de, sizeof(de));
+	dappend(rootino, &de);
 
 	// /bin
 	binino = ialloc(T_DIR);
+	hashalloc(binino);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(binino);
 	strcpy(de.name, ".");
-	iappend(binino, &de, sizeof(de));
+	dappend(binino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(rootino);
 	strcpy(de.name, "..");
-	iappend(binino, &de, sizeof(de));
+	dappend(binino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(binino);
 	strcpy(de.name, "bin");
-	iappend(rootino, &de, sizeof(de));
+	dappend(rootino, &de);
 
 	// /home
 	homeino = ialloc(T_DIR);
+	hashalloc(homeino);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(homeino);
 	strcpy(de.name, ".");
-	iappend(homeino, &de, sizeof(de));
+	dappend(homeino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(rootino);
 	strcpy(de.name, "..");
-	iappend(homeino, &de, sizeof(de));
+	dappend(homeino, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(homeino);
 	strcpy(de.name, "home");
-	iappend(rootino, &de, sizeof(de));
+	dappend(rootino, &de);
 }
 
 int
@@ -225,7 +231,7 @@ main(int argc, char *argv[])
 		bzero(&de, sizeof(de));
 		de.inum = xshort(inum);
 		strncpy(de.name, shortname, DIRSIZ);
-		iappend(dirino, &de, sizeof(de));
+		dappend(dirino, &de);
 
 		while((cc = read(fd, buf, sizeof(buf))) > 0)
 			iappend(inum, buf, cc);
@@ -366,3 +372,40 @@ iappend(uint inum, void *xp, int n)
 	din.size = xint(off);
 	winode(inum, &din);
 }
+
+// Reserve an empty hash index for directory inum.
+// The blocks are already zero, which marks every slot empty.
+void
+hashalloc(uint inum)
+{
+	struct dinode din;
+
+	rinode(inum, &din);
+	din.hashstart = xint(freeblock);
+	freeblock += NDIRHASH;
+	winode(inum, &din);
+}
+
+// Append directory entry de to directory dirino and
+// record it in the directory's hash index.
+void
+dappend(uint dirino, struct dirent *de)
+{
+	struct dinode din;
+	ushort idx[HPB];
+	uint s, bn;
+
+	rinode(dirino, &din);
+	iappend(dirino, de, sizeof(*de));
+
+	s = dirhash(de->name) % DIRHASHSLOTS;
+	for(;;){
+		bn = xint(din.hashstart) + s / HPB;
+		rsect(bn, idx);
+		if(idx[s % HPB] == 0)
+			break;
+		s = (s + 1) % DIRHASHSLOTS;
+	}
+	idx[s % HPB] = xshort(xint(din.size) / sizeof(*de) + 1);
+	wsect(bn, idx);
+}
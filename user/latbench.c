@@ -0,0 +1,64 @@
+// Measure scheduling latency under CPU-bound load.
+// Starts nspin processes that spin forever, then
+// repeatedly sleeps for one tick and reports how many
+// ticks each sleep actually took.  With "low" the
+// spinners are moved to the lowest priority first.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/param.h"
+
+#define NSPIN 4
+#define MAXSPIN 32
+#define NSLEEP 100
+
+int pids[MAXSPIN];
+
+int
+main(int argc, char *argv[])
+{
+	int i, nspin, low, t0, d, total, worst;
+
+	nspin = NSPIN;
+	low = 0;
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "low") == 0)
+			low = 1;
+		else
+			nspin = atoi(argv[i]);
+	}
+	if(nspin < 0 || nspin > MAXSPIN)
+		nspin = NSPIN;
+
+	for(i = 0; i < nspin; i++){
+		if((pids[i] = fork()) < 0){
+			printf("latbench: fork failed\n");
+			exit();
+		}
+		if(pids[i] == 0)
+			for(;;)
+				;
+		if(low)
+			setpriority(pids[i], NPRIO-1);
+	}
+
+	sleep(10);  // Let the spinners use up their slices.
+	total = worst = 0;
+	for(i = 0; i < NSLEEP; i++){
+		t0 = uptime();
+		sleep(1);
+		d = uptime() - t0;
+		total += d;
+		if(d > worst)
+			worst = d;
+	}
+	printf("latbench: %d spinners, %d sleep(1) calls took %d ticks, worst %d\n",
+		nspin, NSLEEP, total, worst);
+
+	for(i = 0; i < nspin; i++){
+		kill(pids[i]);
+		wait();
+	}
+	exit();
+}
@@ -0,0 +1,45 @@
+// Show spin lock contention, by lock name.
+//   lockstat               counters since boot
+//   lockstat cmd args...   counters while cmd runs
+//   lockstat -b            cost of an uncontended acquire/release
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/lockstat.h"
+
+int
+main(int argc, char *argv[])
+{
+	struct lockstat st;
+	int i, n, pid;
+
+	if(argc == 2 && strcmp(argv[1], "-b") == 0){
+		printf("acquire+release: %d cycles\n", lockstat(LOCKSTAT_BENCH, 0));
+		exit();
+	}
+	if(argc > 1){
+		lockstat(LOCKSTAT_RESET, 0);
+		if((pid = fork()) < 0){
+			printf("lockstat: fork failed\n");
+			exit();
+		}
+		if(pid == 0){
+			exec(argv[1], argv+1);
+			printf("lockstat: exec %s failed\n", argv[1]);
+			exit();
+		}
+		wait();
+	}
+
+	printf("name             acquire  contend  spin (Kcycles)\n");
+	for(i = 0; lockstat(i, &st) == 0; i++){
+		if(st.nacquire == 0)
+			continue;
+		printf("%s", st.name);
+		for(n = strlen(st.name); n < LOCKNAME; n++)
+			printf(" ");
+		printf(" %d  %d  %d\n", st.nacquire, st.ncontend, (uint)(st.spin >> 10));
+	}
+	exit();
+}
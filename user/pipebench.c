@@ -0,0 +1,110 @@
+// Measure pipe throughput.
+// A child writes TOTAL bytes into a pipe using write()
+// calls of each size in sizes[] while the parent reads
+// them back, and the rate is reported in MB/s.  An
+// argument sets the pipe buffer size in bytes first.
+// The buffer is page aligned, so writes of whole pages
+// move by remapping rather than copying.  Last, a byte
+// is bounced between two processes NPING times, to show
+// the latency of a pipe handoff.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/fcntl.h"
+
+#define TOTAL (4*1024*1024)
+#define TICKSPERSEC 100
+#define NPING 10000
+
+char buf[16384] __attribute__((aligned(4096)));
+int sizes[] = { 1, 64, 512, 4096, 16384 };
+
+void
+pingpong(void)
+{
+	int ping[2], pong[2], i, start, elapsed;
+	char c;
+
+	if(pipe(ping) < 0 || pipe(pong) < 0){
+		printf("pipebench: pipe failed\n");
+		exit();
+	}
+	start = uptime();
+	if(fork() == 0){
+		for(i = 0; i < NPING; i++)
+			if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+				break;
+		exit();
+	}
+	for(i = 0; i < NPING; i++)
+		if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+			printf("pipebench: ping-pong failed\n");
+			break;
+		}
+	wait();
+	elapsed = uptime() - start;
+	printf("ping-pong: %d round trips in %d ticks", NPING, elapsed);
+	if(elapsed > 0)
+		printf(", %d us each", elapsed*(1000000/TICKSPERSEC)/NPING);
+	printf("\n");
+	close(ping[0]);
+	close(ping[1]);
+	close(pong[0]);
+	close(pong[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd[2], i, n, r, total, psize, start, elapsed, kbps;
+
+	for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+		if(pipe(fd) < 0){
+			printf("pipebench: pipe failed\n");
+			exit();
+		}
+		if(argc > 1 && fcntl(fd[1], F_SETPIPE_SZ, atoi(argv[1])) < 0){
+			printf("pipebench: cannot set pipe size %s\n", argv[1]);
+			exit();
+		}
+		psize = fcntl(fd[1], F_GETPIPE_SZ, 0);
+		// Fewer bytes for tiny writes, which are all overhead.
+		total = sizes[i] < 512 ? TOTAL/64 : TOTAL;
+		start = uptime();
+		n = fork();
+		if(n < 0){
+			printf("pipebench: fork failed\n");
+			exit();
+		}
+		if(n == 0){
+			close(fd[0]);
+			for(n = 0; n < total; n += sizes[i])
+				if(write(fd[1], buf, sizes[i]) != sizes[i]){
+					printf("pipebench: write failed\n");
+					exit();
+				}
+			exit();
+		}
+		close(fd[1]);
+		n = 0;
+		while((r = read(fd[0], buf, sizeof(buf))) > 0)
+			n += r;
+		close(fd[0]);
+		wait();
+		if(n != total){
+			printf("pipebench: read %d bytes, expected %d\n", n, total);
+			exit();
+		}
+		elapsed = uptime() - start;
+		printf("write size %d, pipe %d: %d KB in %d ticks", sizes[i],
+			psize, total/1024, elapsed);
+		if(elapsed > 0){
+			kbps = total/1024*TICKSPERSEC/elapsed;
+			printf(", %d.%d MB/s", kbps/1024, kbps%1024*10/1024);
+		}
+		printf("\n");
+	}
+	pingpong();
+	exit();
+}
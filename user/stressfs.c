@@ -12,11 +12,15 @@
 #include "user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/sysring.h"
+
+struct sysring ring;
 
 int
 main(int argc, char *argv[])
 {
-	int fd, i;
+	int fd, i, ret;
 	char path[] = "stressfs0";
 	char data[512];
 
@@ -30,17 +34,25 @@ main(int argc, char *argv[])
 	printf("write %d\n", i);
 
 	path[8] += i;
+	// Queue the writes and reads and issue each batch in one
+	// system call.
+	ringinit(&ring);
 	fd = open(path, O_CREATE | O_RDWR);
 	for(i = 0; i < 20; i++)
-//    printf(fd, "%d\n", i);
-		write(fd, data, sizeof(data));
+		ringsubmit(&ring, SYS_write, fd, (int)data, sizeof(data), i);
+	ringenter(&ring, 20);
+	while(ringreap(&ring, &ret, 0) == 0)
+		;
 	close(fd);
 
 	printf("read\n");
 
 	fd = open(path, O_RDONLY);
 	for (i = 0; i < 20; i++)
-		read(fd, data, sizeof(data));
+		ringsubmit(&ring, SYS_read, fd, (int)data, sizeof(data), i);
+	ringenter(&ring, 20);
+	while(ringreap(&ring, &ret, 0) == 0)
+		;
 	close(fd);
 
 	wait();
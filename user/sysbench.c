@@ -0,0 +1,68 @@
+// Measure system call latency.
+// Calls getpid NCALL times through int $T_SYSCALL, through
+// sysenter, and NRING at a time through a sysring, and
+// reports TSC cycles per call.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/syscall.h"
+#include "kernel/traps.h"
+#include "kernel/x86.h"
+#include "kernel/sysring.h"
+
+#define NCALL 100000
+
+struct sysring ring;
+
+static int
+getpidint(void)
+{
+	int r;
+
+	asm volatile("int %2" : "=a" (r) : "0" (SYS_getpid), "n" (T_SYSCALL) :
+		     "memory");
+	return r;
+}
+
+static int
+getpidsysenter(void)
+{
+	int r;
+
+	asm volatile("movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1:" :
+		     "=a" (r) : "0" (SYS_getpid) : "ecx", "edx", "memory");
+	return r;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, j, ret;
+	uint t0, tint, tsysenter, tring;
+
+	t0 = rdtsc();
+	for(i = 0; i < NCALL; i++)
+		getpidint();
+	tint = rdtsc() - t0;
+
+	t0 = rdtsc();
+	for(i = 0; i < NCALL; i++)
+		getpidsysenter();
+	tsysenter = rdtsc() - t0;
+
+	ringinit(&ring);
+	t0 = rdtsc();
+	for(i = 0; i < NCALL; i += NRING){
+		for(j = 0; j < NRING; j++)
+			ringsubmit(&ring, SYS_getpid, 0, 0, 0, 0);
+		ringenter(&ring, NRING);
+		while(ringreap(&ring, &ret, 0) == 0)
+			;
+	}
+	tring = rdtsc() - t0;
+
+	printf("getpid: int %d cycles, sysenter %d cycles, ring of %d %d cycles\n",
+		tint/NCALL, tsysenter/NCALL, NRING, tring/NCALL);
+	exit();
+}
@@ -0,0 +1,40 @@
+// Show or set kernel scheduler parameters.
+//   sysctl                 show all
+//   sysctl quantum 5000    set the top-level time slice (us)
+//   sysctl boost 50        set ticks between priority boosts
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/sysctl.h"
+
+struct {
+	char *name;
+	int ctl;
+} ctls[] = {
+	{ "quantum", CTL_QUANTUM },
+	{ "boost",   CTL_BOOST },
+};
+
+int
+main(int argc, char *argv[])
+{
+	int i;
+
+	if(argc != 1 && argc != 3){
+		printf("usage: sysctl [name value]\n");
+		exit();
+	}
+	for(i = 0; i < sizeof(ctls)/sizeof(ctls[0]); i++){
+		if(argc == 1){
+			printf("%s %d\n", ctls[i].name, sysctl(ctls[i].ctl, -1));
+		} else if(strcmp(argv[1], ctls[i].name) == 0){
+			if(sysctl(ctls[i].ctl, atoi(argv[2])) < 0)
+				printf("sysctl: bad value for %s\n", argv[1]);
+			exit();
+		}
+	}
+	if(argc == 3)
+		printf("sysctl: unknown name %s\n", argv[1]);
+	exit();
+}
@@ -3,6 +3,10 @@
 #include "kernel/fcntl.h"
 #include "user.h"
 #include "kernel/x86.h"
+#include "kernel/futex.h"
+#include "kernel/sysring.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -132,3 +136,149 @@ memmove(void *vdst, const void *vsrc, int n)
 		*dst++ = *src++;
 	return vdst;
 }
+
+void
+lock_init(lock_t *lk)
+{
+	lk->locked = 0;
+}
+
+void
+lock_acquire(lock_t *lk)
+{
+	while(xchg(&lk->locked, 1) != 0)
+		;
+}
+
+void
+lock_release(lock_t *lk)
+{
+	xchg(&lk->locked, 0);
+}
+
+// Mutexes that sleep in futex() when contended, after
+// Drepper, "Futexes Are Tricky".  The uncontended paths
+// make no system call.
+void
+mutex_init(mutex_t *m)
+{
+	m->state = 0;
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+	uint c;
+
+	if((c = cmpxchg(&m->state, 0, 1)) == 0)
+		return;
+	if(c != 2)
+		c = xchg(&m->state, 2);
+	while(c != 0){
+		futex(&m->state, FUTEX_WAIT, 2);
+		c = xchg(&m->state, 2);
+	}
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+	if(xchg(&m->state, 0) == 2)
+		futex(&m->state, FUTEX_WAKE, 1);
+}
+
+// Condition variables.  A waiter sleeps until seq moves
+// on from the value it saw while holding the mutex.
+void
+cond_init(cond_t *c)
+{
+	c->seq = 0;
+}
+
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+	uint seq;
+
+	seq = c->seq;
+	mutex_unlock(m);
+	futex(&c->seq, FUTEX_WAIT, seq);
+	mutex_lock(m);
+}
+
+void
+cond_signal(cond_t *c)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
+
+// Batched system calls through a struct sysring; see
+// kernel/sysring.h.  Queue calls with ringsubmit, run them
+// with ringenter(r, n), and collect results with ringreap.
+void
+ringinit(struct sysring *r)
+{
+	memset(r, 0, sizeof(*r));
+}
+
+// Queue system call num(a0, a1, a2), tagged with data.
+// Returns -1 if the submission queue is full.
+int
+ringsubmit(struct sysring *r, int num, int a0, int a1, int a2, uint data)
+{
+	struct sqe *e;
+
+	if(r->sqtail - r->sqhead >= NRING)
+		return -1;
+	e = &r->sq[r->sqtail % NRING];
+	e->num = num;
+	e->arg[0] = a0;
+	e->arg[1] = a1;
+	e->arg[2] = a2;
+	e->data = data;
+	r->sqtail++;
+	return 0;
+}
+
+// Take the oldest result.  Returns -1 if there is none.
+int
+ringreap(struct sysring *r, int *ret, uint *data)
+{
+	struct cqe *c;
+
+	if(r->cqhead == r->cqtail)
+		return -1;
+	c = &r->cq[r->cqhead % NRING];
+	*ret = c->ret;
+	if(data)
+		*data = c->data;
+	r->cqhead++;
+	return 0;
+}
+
+// Read the clock and pid from the vdso pages rather than
+// entering the kernel.  Threads sharing an address space
+// have no pid of their own there, so ask the kernel.
+int
+uptime(void)
+{
+	return ((volatile struct vdso*)VDSO)->ticks;
+}
+
+int
+getpid(void)
+{
+	int pid;
+
+	if((pid = ((volatile struct vdsoproc*)VDSOPROC)->pid) != 0)
+		return pid;
+	return sysgetpid();
+}
@@ -1,5 +1,21 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct sysring;
+
+// spin lock for threads, see ulib.c
+typedef struct {
+	uint locked;
+} lock_t;
+
+// sleeping mutex and condition variable, see ulib.c
+typedef struct {
+	uint state;  // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+	uint seq;
+} cond_t;
 
 // system calls
 int fork(void);
@@ -19,12 +35,21 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
+int sysgetpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int setpriority(int, int);
+int sysctl(int, int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex(uint*, int, int);
+int fcntl(int, int, int);
+int lockstat(int, struct lockstat*);
+int ringenter(struct sysring*, int);
 
 // ulib.c
+int getpid(void);
+int uptime(void);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 char* strncpy(char*, const char*, int);
@@ -40,3 +65,18 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
+void ringinit(struct sysring*);
+int ringsubmit(struct sysring*, int, int, int, int, uint);
+int ringreap(struct sysring*, int*, uint*);
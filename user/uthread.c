@@ -0,0 +1,47 @@
+#include "kernel/types.h"
+#include "user.h"
+
+// Threads.  Each thread runs on a page of stack carved from
+// malloc; the bottom words of that page hold the thread's
+// function, its argument and the block to free at join.
+// malloc itself is not thread-safe.
+#define TSTACK 4096
+
+static void
+thread_start(void *stack)
+{
+	void **t;
+
+	t = stack;
+	((void(*)(void*))t[0])(t[1]);
+	exit();
+}
+
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+	void *mem, **t;
+	int pid;
+
+	if((mem = malloc(2*TSTACK)) == 0)
+		return -1;
+	t = (void**)(((uint)mem + TSTACK-1) & ~(TSTACK-1));
+	t[0] = fn;
+	t[1] = arg;
+	t[2] = mem;
+	if((pid = clone(thread_start, t, t)) < 0)
+		free(mem);
+	return pid;
+}
+
+// Wait for a thread to finish and free its stack.
+int
+thread_join(void)
+{
+	void **t;
+	int pid;
+
+	if((pid = join((void**)&t)) >= 0)
+		free(t[2]);
+	return pid;
+}
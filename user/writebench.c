@@ -0,0 +1,54 @@
+// Measure large-file write throughput.
+// Writes a file of FILESIZE bytes ROUNDS times, using
+// write() calls of each size in sizes[], and reports
+// the bytes written per clock tick.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+#include "kernel/fcntl.h"
+
+#define FILESIZE (64*1024)
+#define ROUNDS 8
+
+char buf[FILESIZE];
+int sizes[] = { 512, 1536, 4096, 16384, FILESIZE };
+
+int
+main(int argc, char *argv[])
+{
+	int fd, i, r, n, off, start, elapsed;
+
+	printf("writebench: %d KB file, %d rounds\n", FILESIZE/1024, ROUNDS);
+	memset(buf, 'w', sizeof(buf));
+
+	for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+		start = uptime();
+		for(r = 0; r < ROUNDS; r++){
+			fd = open("writebench.tmp", O_CREATE | O_RDWR);
+			if(fd < 0){
+				printf("writebench: open failed\n");
+				exit();
+			}
+			for(off = 0; off < FILESIZE; off += n){
+				n = sizes[i];
+				if(n > FILESIZE - off)
+					n = FILESIZE - off;
+				if(write(fd, buf + off, n) != n){
+					printf("writebench: write failed\n");
+					exit();
+				}
+			}
+			close(fd);
+			unlink("writebench.tmp");
+		}
+		elapsed = uptime() - start;
+		printf("write size %d: %d KB in %d ticks", sizes[i],
+			ROUNDS*FILESIZE/1024, elapsed);
+		if(elapsed > 0)
+			printf(", %d bytes/tick", ROUNDS*FILESIZE/elapsed);
+		printf("\n");
+	}
+
+	exit();
+}